@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QMap>
+#include <QSaveFile>
+
+#include "actionjournal.h"
+#include "logging_p.h"
+
+namespace {
+
+// The file is rewritten once it has this many lines and most of them are obsolete
+const int CompactionThreshold = 128;
+
+quint64 recordId(const QJsonObject &record)
+{
+    return record.value(QStringLiteral("id")).toVariant().toULongLong();
+}
+
+}
+
+ActionJournal::ActionJournal(const QString &fileName)
+    : m_file(fileName),
+      m_lineCount(0)
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+}
+
+ActionJournal::~ActionJournal()
+{
+}
+
+QList<ActionJournal::Entry> ActionJournal::takeEntries(qint64 maximumAge)
+{
+    // Sorted by id, which is the queue order
+    QMap<quint64, QJsonObject> pending;
+    m_file.close();
+    if (m_file.open(QIODevice::ReadOnly)) {
+        while (!m_file.atEnd()) {
+            const QByteArray line = m_file.readLine().trimmed();
+            if (line.isEmpty()) {
+                continue;
+            }
+            QJsonParseError error;
+            const QJsonObject record = QJsonDocument::fromJson(line, &error).object();
+            if (error.error != QJsonParseError::NoError) {
+                // Most likely a write cut short when the process went away
+                qCWarning(lcEmail) << "Skipping unreadable action journal line:" << error.errorString();
+                continue;
+            }
+            if (record.value(QStringLiteral("done")).toBool()) {
+                pending.remove(recordId(record));
+            } else {
+                pending.insert(recordId(record), record);
+            }
+        }
+        m_file.close();
+    }
+
+    m_records.clear();
+    compact();
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QList<Entry> entries;
+    for (const QJsonObject &record : pending) {
+        Entry entry;
+        entry.name = record.value(QStringLiteral("name")).toString();
+        entry.parameters = record.value(QStringLiteral("parameters")).toObject().toVariantMap();
+        entry.priority = record.value(QStringLiteral("priority")).toInt(-1);
+        entry.created = qint64(record.value(QStringLiteral("created")).toDouble());
+        if (entry.name.isEmpty() || now - entry.created > maximumAge) {
+            qCDebug(lcEmail) << "Dropping stale journaled action" << entry.name;
+            continue;
+        }
+        entries.append(entry);
+    }
+    return entries;
+}
+
+void ActionJournal::add(quint64 actionId, const Entry &entry)
+{
+    QJsonObject record;
+    record.insert(QStringLiteral("id"), double(actionId));
+    record.insert(QStringLiteral("name"), entry.name);
+    record.insert(QStringLiteral("parameters"), QJsonObject::fromVariantMap(entry.parameters));
+    record.insert(QStringLiteral("priority"), entry.priority);
+    record.insert(QStringLiteral("created"), double(entry.created));
+
+    m_records.insert(actionId, record);
+    append(record);
+}
+
+void ActionJournal::remove(quint64 actionId)
+{
+    if (!m_records.remove(actionId)) {
+        return;
+    }
+
+    QJsonObject record;
+    record.insert(QStringLiteral("id"), double(actionId));
+    record.insert(QStringLiteral("done"), true);
+    append(record);
+
+    if (m_lineCount >= CompactionThreshold && m_lineCount > 2 * m_records.count()) {
+        compact();
+    }
+}
+
+bool ActionJournal::append(const QJsonObject &record)
+{
+    if (!m_file.isOpen() && !m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(lcEmail) << "Cannot open action journal" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+
+    // A line per write keeps a partial write from corrupting the earlier records
+    m_file.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+    m_file.flush();
+    m_lineCount++;
+    return true;
+}
+
+void ActionJournal::compact()
+{
+    m_file.close();
+
+    QMap<quint64, QJsonObject> records;
+    for (QHash<quint64, QJsonObject>::const_iterator it = m_records.constBegin(); it != m_records.constEnd(); ++it) {
+        records.insert(it.key(), it.value());
+    }
+
+    QSaveFile file(m_file.fileName());
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcEmail) << "Cannot write action journal" << file.fileName() << file.errorString();
+        return;
+    }
+    for (const QJsonObject &record : records) {
+        file.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+    }
+    if (file.commit()) {
+        m_lineCount = records.count();
+    } else {
+        qCWarning(lcEmail) << "Cannot write action journal" << file.fileName() << file.errorString();
+    }
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef ACTIONJOURNAL_H
+#define ACTIONJOURNAL_H
+
+#include <QFile>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QVariantMap>
+
+// Append-only record of the queued actions, so that the ones left unfinished
+// when the process went away can be queued again on the next start. Each line
+// is a JSON object, either adding an action or marking one done. The file is
+// rewritten with only the pending actions once most of its lines are obsolete.
+class ActionJournal
+{
+public:
+    struct Entry {
+        Entry() : priority(-1), created(0) {}
+
+        QString name;
+        QVariantMap parameters;
+        int priority;
+        // Milliseconds since the epoch the action was first queued
+        qint64 created;
+    };
+
+    explicit ActionJournal(const QString &fileName);
+    ~ActionJournal();
+
+    // Pending actions of the previous run not older than maximumAge milliseconds,
+    // in the order they were queued. The journal is emptied, the actions queued
+    // again are added back.
+    QList<Entry> takeEntries(qint64 maximumAge);
+    void add(quint64 actionId, const Entry &entry);
+    void remove(quint64 actionId);
+
+private:
+    bool append(const QJsonObject &record);
+    void compact();
+
+    QFile m_file;
+    QHash<quint64, QJsonObject> m_records;
+    int m_lineCount;
+};
+
+#endif
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "actionstatistics.h"
+#include "logging_p.h"
+
+namespace {
+
+// Upper bounds of the histogram buckets in milliseconds, the last bucket takes the rest
+const qint64 BucketBounds[] = { 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000 };
+const int BucketCount = sizeof(BucketBounds) / sizeof(BucketBounds[0]) + 1;
+
+// In the order of EmailAction::ActionType
+const char * const TypeNames[] = {
+    "Export",
+    "Retrieve",
+    "RetrieveFolderList",
+    "RetrieveMessages",
+    "RetrieveMessagePart",
+    "Search",
+    "Send",
+    "StandardFolders",
+    "Storage",
+    "Transmit",
+    "CalendarInvitationResponse",
+    "OnlineCreateFolder",
+    "OnlineDeleteFolder",
+    "OnlineRenameFolder",
+    "OnlineMoveFolder"
+};
+const int TypeNameCount = sizeof(TypeNames) / sizeof(TypeNames[0]);
+
+QString typeName(int type)
+{
+    return type >= 0 && type < TypeNameCount ? QString::fromLatin1(TypeNames[type]) : QString::number(type);
+}
+
+QVariantList histogramToList(const QVector<int> &histogram)
+{
+    QVariantList counts;
+    for (int count : histogram) {
+        counts.append(count);
+    }
+    return counts;
+}
+
+}
+
+ActionStatistics::TypeCounters::TypeCounters()
+    : queued(0),
+      succeeded(0),
+      failed(0),
+      cancelled(0),
+      preempted(0),
+      retried(0),
+      totalWait(0),
+      totalExecution(0),
+      waitHistogram(BucketCount, 0),
+      executionHistogram(BucketCount, 0)
+{
+}
+
+ActionStatistics::ActionStatistics(QObject *parent)
+    : QObject(parent),
+      m_maximumQueueDepth(0)
+{
+    m_clock.start();
+    connect(&m_dumpTimer, SIGNAL(timeout()), this, SLOT(dump()));
+}
+
+ActionStatistics::~ActionStatistics()
+{
+}
+
+void ActionStatistics::actionQueued(quint64 actionId, EmailAction::ActionType type, const QMailAccountId &accountId)
+{
+    Tracked tracked;
+    tracked.type = type;
+    tracked.accountId = accountId;
+    tracked.queued = m_clock.elapsed();
+    tracked.started = -1;
+    tracked.executed = 0;
+    m_tracked.insert(actionId, tracked);
+
+    m_types[type].queued++;
+    m_accounts[accountId].queued++;
+    m_maximumQueueDepth = qMax(m_maximumQueueDepth, m_tracked.count());
+}
+
+void ActionStatistics::actionStarted(quint64 actionId)
+{
+    QHash<quint64, Tracked>::iterator it = m_tracked.find(actionId);
+    if (it == m_tracked.end() || it->started >= 0) {
+        return;
+    }
+
+    // Each wait in the queue is counted, also the ones after a preemption or a failure
+    const qint64 now = m_clock.elapsed();
+    TypeCounters &counters = m_types[it->type];
+    const qint64 wait = now - it->queued;
+    counters.totalWait += wait;
+    counters.waitHistogram[bucket(wait)]++;
+    it->started = now;
+}
+
+void ActionStatistics::actionPreempted(quint64 actionId)
+{
+    QHash<quint64, Tracked>::iterator it = m_tracked.find(actionId);
+    if (it != m_tracked.end()) {
+        m_types[it->type].preempted++;
+        requeue(&it.value());
+    }
+}
+
+void ActionStatistics::actionRetried(quint64 actionId)
+{
+    QHash<quint64, Tracked>::iterator it = m_tracked.find(actionId);
+    if (it != m_tracked.end()) {
+        m_types[it->type].retried++;
+        requeue(&it.value());
+    }
+}
+
+void ActionStatistics::actionFinished(quint64 actionId, Outcome outcome)
+{
+    QHash<quint64, Tracked>::iterator it = m_tracked.find(actionId);
+    if (it == m_tracked.end()) {
+        return;
+    }
+
+    TypeCounters &counters = m_types[it->type];
+    AccountCounters &accountCounters = m_accounts[it->accountId];
+    // The run time of all attempts together
+    if (it->started >= 0 || it->executed > 0) {
+        const qint64 execution = it->executed + (it->started >= 0 ? m_clock.elapsed() - it->started : 0);
+        counters.totalExecution += execution;
+        counters.executionHistogram[bucket(execution)]++;
+    }
+
+    switch (outcome) {
+    case Succeeded:
+        counters.succeeded++;
+        accountCounters.succeeded++;
+        break;
+    case Failed:
+        counters.failed++;
+        accountCounters.failed++;
+        break;
+    case Cancelled:
+        counters.cancelled++;
+        accountCounters.cancelled++;
+        break;
+    }
+    m_tracked.erase(it);
+}
+
+QVariantMap ActionStatistics::snapshot() const
+{
+    int running = 0;
+    for (const Tracked &tracked : m_tracked) {
+        if (tracked.started >= 0) {
+            running++;
+        }
+    }
+
+    QVariantList bounds;
+    for (qint64 bound : BucketBounds) {
+        bounds.append(bound);
+    }
+
+    QVariantMap types;
+    for (QHash<int, TypeCounters>::const_iterator it = m_types.constBegin(); it != m_types.constEnd(); ++it) {
+        const TypeCounters &counters = it.value();
+        int waitCount = 0;
+        int executionCount = 0;
+        for (int i = 0; i < BucketCount; i++) {
+            waitCount += counters.waitHistogram.at(i);
+            executionCount += counters.executionHistogram.at(i);
+        }
+
+        QVariantMap type;
+        type.insert(QStringLiteral("queued"), counters.queued);
+        type.insert(QStringLiteral("succeeded"), counters.succeeded);
+        type.insert(QStringLiteral("failed"), counters.failed);
+        type.insert(QStringLiteral("cancelled"), counters.cancelled);
+        type.insert(QStringLiteral("preempted"), counters.preempted);
+        type.insert(QStringLiteral("retried"), counters.retried);
+        type.insert(QStringLiteral("queueWait"), histogramToList(counters.waitHistogram));
+        type.insert(QStringLiteral("execution"), histogramToList(counters.executionHistogram));
+        type.insert(QStringLiteral("averageQueueWait"), waitCount ? counters.totalWait / waitCount : 0);
+        type.insert(QStringLiteral("averageExecution"), executionCount ? counters.totalExecution / executionCount : 0);
+        types.insert(typeName(it.key()), type);
+    }
+
+    // Actions not bound to an account are counted under account zero
+    QVariantMap accounts;
+    for (QHash<QMailAccountId, AccountCounters>::const_iterator it = m_accounts.constBegin(); it != m_accounts.constEnd(); ++it) {
+        QVariantMap account;
+        account.insert(QStringLiteral("queued"), it->queued);
+        account.insert(QStringLiteral("succeeded"), it->succeeded);
+        account.insert(QStringLiteral("failed"), it->failed);
+        account.insert(QStringLiteral("cancelled"), it->cancelled);
+        accounts.insert(QString::number(it.key().toULongLong()), account);
+    }
+
+    QVariantMap result;
+    result.insert(QStringLiteral("queueDepth"), m_tracked.count() - running);
+    result.insert(QStringLiteral("running"), running);
+    result.insert(QStringLiteral("maximumQueueDepth"), m_maximumQueueDepth);
+    result.insert(QStringLiteral("histogramBounds"), bounds);
+    result.insert(QStringLiteral("types"), types);
+    result.insert(QStringLiteral("accounts"), accounts);
+    return result;
+}
+
+void ActionStatistics::reset()
+{
+    // Actions still queued are kept, their times are counted when they finish
+    m_types.clear();
+    m_accounts.clear();
+    m_maximumQueueDepth = m_tracked.count();
+}
+
+int ActionStatistics::dumpInterval() const
+{
+    return m_dumpTimer.isActive() ? m_dumpTimer.interval() / 1000 : 0;
+}
+
+void ActionStatistics::setDumpInterval(int seconds)
+{
+    if (seconds > 0) {
+        m_dumpTimer.start(seconds * 1000);
+    } else {
+        m_dumpTimer.stop();
+    }
+}
+
+void ActionStatistics::dump()
+{
+    qCDebug(lcEmail).noquote() << "Action statistics:"
+                               << QJsonDocument(QJsonObject::fromVariantMap(snapshot())).toJson(QJsonDocument::Compact);
+}
+
+void ActionStatistics::requeue(Tracked *tracked)
+{
+    const qint64 now = m_clock.elapsed();
+    if (tracked->started >= 0) {
+        tracked->executed += now - tracked->started;
+        tracked->started = -1;
+    }
+    tracked->queued = now;
+}
+
+int ActionStatistics::bucket(qint64 milliseconds)
+{
+    for (int i = 0; i < BucketCount - 1; i++) {
+        if (milliseconds <= BucketBounds[i]) {
+            return i;
+        }
+    }
+    return BucketCount - 1;
+}
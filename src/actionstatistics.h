@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef ACTIONSTATISTICS_H
+#define ACTIONSTATISTICS_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+#include <QVariantMap>
+#include <QVector>
+
+#include <qmailaccount.h>
+
+#include "emailaction.h"
+
+// Counts how long the queued actions wait and run, per action type and per account.
+// Times go to histograms with exponentially growing buckets, the snapshot reports
+// them together with the outcomes and the current queue depth. The snapshot can be
+// written to the log periodically.
+class ActionStatistics : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Outcome {
+        Succeeded,
+        Failed,
+        Cancelled
+    };
+
+    explicit ActionStatistics(QObject *parent = 0);
+    ~ActionStatistics();
+
+    void actionQueued(quint64 actionId, EmailAction::ActionType type, const QMailAccountId &accountId);
+    void actionStarted(quint64 actionId);
+    // Gave way to another action and waits in the queue again
+    void actionPreempted(quint64 actionId);
+    // Failed on the connection and waits in the queue to be tried again
+    void actionRetried(quint64 actionId);
+    // Actions not known or already finished are ignored
+    void actionFinished(quint64 actionId, Outcome outcome);
+
+    QVariantMap snapshot() const;
+    void reset();
+
+    // Seconds between the snapshots written to the log, zero disables them
+    int dumpInterval() const;
+    void setDumpInterval(int seconds);
+
+public slots:
+    void dump();
+
+private:
+    struct Tracked {
+        EmailAction::ActionType type;
+        QMailAccountId accountId;
+        // Since when the action waits in the queue, or has been running if started is set
+        qint64 queued;
+        qint64 started;
+        // Run time of the earlier attempts
+        qint64 executed;
+    };
+
+    struct TypeCounters {
+        TypeCounters();
+
+        int queued;
+        int succeeded;
+        int failed;
+        int cancelled;
+        int preempted;
+        int retried;
+        qint64 totalWait;
+        qint64 totalExecution;
+        QVector<int> waitHistogram;
+        QVector<int> executionHistogram;
+    };
+
+    struct AccountCounters {
+        AccountCounters() : queued(0), succeeded(0), failed(0), cancelled(0) {}
+
+        int queued;
+        int succeeded;
+        int failed;
+        int cancelled;
+    };
+
+    static int bucket(qint64 milliseconds);
+    void requeue(Tracked *tracked);
+
+    QElapsedTimer m_clock;
+    QHash<quint64, Tracked> m_tracked;
+    QHash<int, TypeCounters> m_types;
+    QHash<QMailAccountId, AccountCounters> m_accounts;
+    int m_maximumQueueDepth;
+    QTimer m_dumpTimer;
+};
+
+#endif
@@ -0,0 +1,963 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <algorithm>
+
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QMap>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVector>
+#include <QtConcurrent>
+
+#include <qmailstore.h>
+
+#include "bodysearchindex.h"
+#include "logging_p.h"
+
+namespace {
+
+const quint32 IndexMagic = 0x4942454e; // "NEBI"
+const quint32 IndexVersion = 1;
+
+// Shorter words are neither indexed nor looked up, longer ones are cut
+const int MinWordLength = 2;
+const int MaxWordLength = 48;
+// Only the beginning of very long bodies is indexed
+const int MaxBodyLength = 256 * 1024;
+
+// Milliseconds spent indexing per timer round and between the rounds, keeping
+// the event loop responsive while the index is built
+const int IndexBudget = 5;
+const int IndexInterval = 50;
+// Changes are appended to the log files once indexing has been idle for a while,
+// or after this many messages while backfilling
+const int FlushInterval = 5000;
+const int FlushBatchSize = 1000;
+// Size of the log from which it is merged into the index file
+const qint64 MergeThreshold = 4 * 1024 * 1024;
+
+QString stripTags(const QString &html)
+{
+    QString text;
+    text.reserve(html.size());
+    bool inTag = false;
+    for (const QChar &c : html) {
+        if (c == QLatin1Char('<')) {
+            inTag = true;
+        } else if (c == QLatin1Char('>')) {
+            inTag = false;
+            text.append(QLatin1Char(' '));
+        } else if (!inTag) {
+            text.append(c);
+        }
+    }
+    return text;
+}
+
+// Only the text part is decoded, other parts are left alone
+QString bodyText(const QMailMessage &message)
+{
+    if (QMailMessagePartContainer *container = message.findPlainTextContainer()) {
+        return container->body().data();
+    }
+    if (QMailMessagePartContainer *container = message.findHtmlContainer()) {
+        return stripTags(container->body().data());
+    }
+    return QString();
+}
+
+QMailMessageKey contentAvailableKey()
+{
+    return QMailMessageKey::status(QMailMessage::ContentAvailable, QMailDataComparator::Includes)
+            | QMailMessageKey::status(QMailMessage::PartialContentAvailable, QMailDataComparator::Includes);
+}
+
+}
+
+// Index of a single account. The file holds a header, the word table sorted by
+// the UTF-8 bytes of the words, the posting lists with the message ids of each word,
+// the sorted ids of all indexed messages and finally the text of the words.
+// Changes since the file was written are kept in memory and appended to a delta
+// log next to it, which is replayed on start. Once the log has grown large enough
+// it is merged into the file on a worker thread. Until the merge is done the
+// merged changes stay in memory as a layer between the file and the newer changes.
+class BodySearchIndex::Segment
+{
+public:
+    struct Delta {
+        QHash<QByteArray, QSet<quint64> > added;
+        QSet<quint64> addedDocuments;
+        QSet<quint64> removed;
+    };
+
+    explicit Segment(const QString &fileName);
+    ~Segment();
+
+    bool contains(quint64 id) const;
+    QVector<quint64> documents() const;
+    void insert(quint64 id, const QStringList &words);
+    void remove(quint64 id);
+    void lookup(const QByteArray &part, QSet<quint64> *result) const;
+    bool isDirty() const;
+    bool flush();
+    bool needsMerge() const;
+    QFuture<bool> startMerge();
+    void finishMerge(bool merged);
+    void discard();
+
+private:
+    enum RecordType {
+        InsertRecord = 1,
+        RemoveRecord = 2
+    };
+
+    struct Header {
+        quint32 magic;
+        quint32 version;
+        quint32 wordCount;
+        quint32 postingCount;
+        quint32 documentCount;
+        quint32 textSize;
+    };
+
+    struct WordEntry {
+        quint32 textOffset;
+        quint32 textLength;
+        quint32 postingOffset;
+        quint32 postingCount;
+    };
+
+    struct Mapping {
+        Mapping() : data(0), header(0), words(0), postings(0), documents(0), text(0) {}
+
+        uchar *data;
+        const Header *header;
+        const WordEntry *words;
+        const quint64 *postings;
+        const quint64 *documents;
+        const char *text;
+    };
+
+    static bool mapFile(QFile *file, Mapping *mapping);
+    static void unmapFile(QFile *file, Mapping *mapping);
+    static bool writeMerged(const QString &fileName, const Delta &delta);
+    static void dropWords(Delta *delta, quint64 id);
+
+    void map();
+    void unmap();
+    void replay();
+    bool apply(RecordType type, quint64 id, const QStringList &words);
+    quint32 wordCount() const;
+    quint32 documentCount() const;
+    bool wordContains(quint32 index, const QByteArray &part) const;
+    bool mappedContains(quint64 id) const;
+    bool lowerContains(quint64 id) const;
+
+    QFile m_file;
+    Mapping m_mapping;
+    QString m_deltaFileName;
+    qint64 m_deltaSize;
+    // Records not yet appended to the delta log
+    QByteArray m_records;
+
+    // Changes being merged into the file, and the ones since
+    Delta m_merging;
+    Delta m_delta;
+    QFuture<bool> m_merge;
+    qint64 m_mergeOffset;
+};
+
+BodySearchIndex::Segment::Segment(const QString &fileName)
+    : m_file(fileName),
+      m_deltaFileName(fileName + QLatin1String(".delta")),
+      m_deltaSize(0),
+      m_mergeOffset(0)
+{
+    map();
+    replay();
+}
+
+BodySearchIndex::Segment::~Segment()
+{
+    // The merge only reads the file and its own copy of the changes, but the
+    // file it writes must not be mapped again half way
+    m_merge.waitForFinished();
+    unmap();
+}
+
+bool BodySearchIndex::Segment::mapFile(QFile *file, Mapping *mapping)
+{
+    *mapping = Mapping();
+    if (!file->open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 size = file->size();
+    uchar *data = size >= qint64(sizeof(Header)) ? file->map(0, size) : 0;
+    if (data) {
+        const Header *header = reinterpret_cast<const Header *>(data);
+        const qint64 expectedSize = sizeof(Header) + qint64(header->wordCount) * sizeof(WordEntry)
+                + (qint64(header->postingCount) + header->documentCount) * sizeof(quint64)
+                + header->textSize;
+
+        if (header->magic == IndexMagic && header->version == IndexVersion && expectedSize == size) {
+            const WordEntry *words = reinterpret_cast<const WordEntry *>(data + sizeof(Header));
+            bool valid = true;
+            for (quint32 i = 0; i < header->wordCount && valid; i++) {
+                const WordEntry &entry = words[i];
+                valid = quint64(entry.textOffset) + entry.textLength <= header->textSize
+                        && quint64(entry.postingOffset) + entry.postingCount <= header->postingCount;
+            }
+            if (valid) {
+                mapping->data = data;
+                mapping->header = header;
+                mapping->words = words;
+                mapping->postings = reinterpret_cast<const quint64 *>(words + header->wordCount);
+                mapping->documents = mapping->postings + header->postingCount;
+                mapping->text = reinterpret_cast<const char *>(mapping->documents + header->documentCount);
+                return true;
+            }
+        }
+        file->unmap(data);
+    }
+
+    file->close();
+    return false;
+}
+
+void BodySearchIndex::Segment::unmapFile(QFile *file, Mapping *mapping)
+{
+    if (mapping->data) {
+        file->unmap(mapping->data);
+    }
+    file->close();
+    *mapping = Mapping();
+}
+
+// Runs on a worker thread, touching nothing but the file and its arguments
+bool BodySearchIndex::Segment::writeMerged(const QString &fileName, const Delta &delta)
+{
+    QFile mappedFile(fileName);
+    Mapping mapping;
+    if (mappedFile.exists() && !mapFile(&mappedFile, &mapping)) {
+        qCWarning(lcEmail) << "Rewriting invalid body search index" << fileName;
+    }
+    const quint32 wordCount = mapping.header ? mapping.header->wordCount : 0;
+    const quint32 documentCount = mapping.header ? mapping.header->documentCount : 0;
+
+    // Merge the mapped words with the changes, sorted by the word bytes
+    QMap<QByteArray, QVector<quint64> > postings;
+    for (quint32 i = 0; i < wordCount; i++) {
+        const WordEntry &entry = mapping.words[i];
+        QVector<quint64> ids;
+        for (quint32 j = 0; j < entry.postingCount; j++) {
+            const quint64 id = mapping.postings[entry.postingOffset + j];
+            if (!delta.removed.contains(id)) {
+                ids.append(id);
+            }
+        }
+        if (!ids.isEmpty()) {
+            postings.insert(QByteArray(mapping.text + entry.textOffset, entry.textLength), ids);
+        }
+    }
+    for (auto it = delta.added.constBegin(); it != delta.added.constEnd(); ++it) {
+        QVector<quint64> &ids = postings[it.key()];
+        for (quint64 id : it.value()) {
+            if (delta.addedDocuments.contains(id)) {
+                ids.append(id);
+            }
+        }
+    }
+
+    QVector<quint64> documentIds;
+    documentIds.reserve(documentCount + delta.addedDocuments.count());
+    for (quint32 i = 0; i < documentCount; i++) {
+        if (!delta.removed.contains(mapping.documents[i])) {
+            documentIds.append(mapping.documents[i]);
+        }
+    }
+    for (quint64 id : delta.addedDocuments) {
+        documentIds.append(id);
+    }
+    std::sort(documentIds.begin(), documentIds.end());
+    documentIds.erase(std::unique(documentIds.begin(), documentIds.end()), documentIds.end());
+
+    QVector<WordEntry> entries;
+    QVector<quint64> postingIds;
+    QByteArray text;
+    entries.reserve(postings.size());
+    for (auto it = postings.begin(); it != postings.end(); ++it) {
+        QVector<quint64> &ids = it.value();
+        if (ids.isEmpty()) {
+            continue;
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+        WordEntry entry;
+        entry.textOffset = text.size();
+        entry.textLength = it.key().size();
+        entry.postingOffset = postingIds.size();
+        entry.postingCount = ids.size();
+        entries.append(entry);
+        text.append(it.key());
+        postingIds += ids;
+    }
+    unmapFile(&mappedFile, &mapping);
+
+    Header header;
+    header.magic = IndexMagic;
+    header.version = IndexVersion;
+    header.wordCount = entries.size();
+    header.postingCount = postingIds.size();
+    header.documentCount = documentIds.size();
+    header.textSize = text.size();
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcEmail) << "Cannot write body search index" << file.fileName() << file.errorString();
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char *>(entries.constData()), entries.size() * sizeof(WordEntry));
+    file.write(reinterpret_cast<const char *>(postingIds.constData()), postingIds.size() * sizeof(quint64));
+    file.write(reinterpret_cast<const char *>(documentIds.constData()), documentIds.size() * sizeof(quint64));
+    file.write(text);
+
+    if (!file.commit()) {
+        qCWarning(lcEmail) << "Cannot write body search index" << file.fileName() << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void BodySearchIndex::Segment::dropWords(Delta *delta, quint64 id)
+{
+    for (auto it = delta->added.begin(); it != delta->added.end();) {
+        it.value().remove(id);
+        if (it.value().isEmpty()) {
+            it = delta->added.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void BodySearchIndex::Segment::map()
+{
+    if (m_file.exists() && !mapFile(&m_file, &m_mapping)) {
+        qCWarning(lcEmail) << "Discarding invalid body search index" << m_file.fileName();
+        QFile::remove(m_file.fileName());
+        // The changes in the log are relative to the discarded file
+        QFile::remove(m_deltaFileName);
+    }
+}
+
+void BodySearchIndex::Segment::unmap()
+{
+    unmapFile(&m_file, &m_mapping);
+}
+
+void BodySearchIndex::Segment::replay()
+{
+    QFile file(m_deltaFileName);
+    if (!file.open(QIODevice::ReadWrite)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+    qint64 validSize = 0;
+    while (!stream.atEnd()) {
+        quint8 type = 0;
+        quint64 id = 0;
+        QStringList words;
+        stream >> type >> id;
+        if (type == InsertRecord) {
+            quint32 count = 0;
+            stream >> count;
+            for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+                QByteArray word;
+                stream >> word;
+                words.append(QString::fromUtf8(word));
+            }
+        } else if (type != RemoveRecord) {
+            stream.setStatus(QDataStream::ReadCorruptData);
+        }
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+        apply(RecordType(type), id, words);
+        validSize = file.pos();
+    }
+
+    // A record cut short when the process went away, the next ones are appended after the last whole one
+    if (validSize < file.size()) {
+        qCWarning(lcEmail) << "Dropping the end of body search index log" << m_deltaFileName;
+        file.resize(validSize);
+    }
+    m_deltaSize = validSize;
+}
+
+bool BodySearchIndex::Segment::apply(RecordType type, quint64 id, const QStringList &words)
+{
+    bool changed = false;
+    if (m_delta.addedDocuments.remove(id)) {
+        dropWords(&m_delta, id);
+        changed = true;
+    }
+    if (lowerContains(id) && !m_delta.removed.contains(id)) {
+        m_delta.removed.insert(id);
+        changed = true;
+    }
+
+    if (type == InsertRecord) {
+        m_delta.addedDocuments.insert(id);
+        for (const QString &word : words) {
+            m_delta.added[word.toUtf8()].insert(id);
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+quint32 BodySearchIndex::Segment::wordCount() const
+{
+    return m_mapping.header ? m_mapping.header->wordCount : 0;
+}
+
+quint32 BodySearchIndex::Segment::documentCount() const
+{
+    return m_mapping.header ? m_mapping.header->documentCount : 0;
+}
+
+bool BodySearchIndex::Segment::wordContains(quint32 index, const QByteArray &part) const
+{
+    const WordEntry &entry = m_mapping.words[index];
+    return int(entry.textLength) >= part.size()
+            && QByteArray::fromRawData(m_mapping.text + entry.textOffset, entry.textLength).contains(part);
+}
+
+bool BodySearchIndex::Segment::mappedContains(quint64 id) const
+{
+    return std::binary_search(m_mapping.documents, m_mapping.documents + documentCount(), id);
+}
+
+bool BodySearchIndex::Segment::lowerContains(quint64 id) const
+{
+    return m_merging.addedDocuments.contains(id)
+            || (mappedContains(id) && !m_merging.removed.contains(id));
+}
+
+bool BodySearchIndex::Segment::contains(quint64 id) const
+{
+    return m_delta.addedDocuments.contains(id) || (lowerContains(id) && !m_delta.removed.contains(id));
+}
+
+QVector<quint64> BodySearchIndex::Segment::documents() const
+{
+    QVector<quint64> result;
+    result.reserve(documentCount() + m_merging.addedDocuments.count() + m_delta.addedDocuments.count());
+    for (quint32 i = 0; i < documentCount(); i++) {
+        const quint64 id = m_mapping.documents[i];
+        if (!m_merging.removed.contains(id) && !m_delta.removed.contains(id)) {
+            result.append(id);
+        }
+    }
+    for (quint64 id : m_merging.addedDocuments) {
+        if (!m_delta.removed.contains(id)) {
+            result.append(id);
+        }
+    }
+    for (quint64 id : m_delta.addedDocuments) {
+        result.append(id);
+    }
+    return result;
+}
+
+void BodySearchIndex::Segment::insert(quint64 id, const QStringList &words)
+{
+    apply(InsertRecord, id, words);
+
+    QDataStream stream(&m_records, QIODevice::WriteOnly | QIODevice::Append);
+    stream << quint8(InsertRecord) << id << quint32(words.count());
+    for (const QString &word : words) {
+        stream << word.toUtf8();
+    }
+}
+
+void BodySearchIndex::Segment::remove(quint64 id)
+{
+    if (apply(RemoveRecord, id, QStringList())) {
+        QDataStream stream(&m_records, QIODevice::WriteOnly | QIODevice::Append);
+        stream << quint8(RemoveRecord) << id;
+    }
+}
+
+void BodySearchIndex::Segment::lookup(const QByteArray &part, QSet<quint64> *result) const
+{
+    // A scan over the word table rather than a binary search, the part may be
+    // anywhere in a word
+    for (quint32 i = 0; i < wordCount(); i++) {
+        if (!wordContains(i, part)) {
+            continue;
+        }
+        const WordEntry &entry = m_mapping.words[i];
+        const quint64 *postings = m_mapping.postings + entry.postingOffset;
+        for (quint32 j = 0; j < entry.postingCount; j++) {
+            if (!m_merging.removed.contains(postings[j]) && !m_delta.removed.contains(postings[j])) {
+                result->insert(postings[j]);
+            }
+        }
+    }
+
+    for (auto it = m_merging.added.constBegin(); it != m_merging.added.constEnd(); ++it) {
+        if (it.key().contains(part)) {
+            for (quint64 id : it.value()) {
+                if (m_merging.addedDocuments.contains(id) && !m_delta.removed.contains(id)) {
+                    result->insert(id);
+                }
+            }
+        }
+    }
+
+    for (auto it = m_delta.added.constBegin(); it != m_delta.added.constEnd(); ++it) {
+        if (it.key().contains(part)) {
+            for (quint64 id : it.value()) {
+                result->insert(id);
+            }
+        }
+    }
+}
+
+bool BodySearchIndex::Segment::isDirty() const
+{
+    return !m_records.isEmpty();
+}
+
+bool BodySearchIndex::Segment::flush()
+{
+    if (m_records.isEmpty()) {
+        return true;
+    }
+
+    // Only the records since the last flush are written
+    QFile file(m_deltaFileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(lcEmail) << "Cannot write body search index log" << m_deltaFileName << file.errorString();
+        return false;
+    }
+    if (file.write(m_records) != m_records.size()) {
+        qCWarning(lcEmail) << "Cannot write body search index log" << m_deltaFileName << file.errorString();
+        return false;
+    }
+    m_deltaSize += m_records.size();
+    m_records.clear();
+    return true;
+}
+
+bool BodySearchIndex::Segment::needsMerge() const
+{
+    return m_deltaSize >= MergeThreshold && !m_merge.isRunning() && m_merging.addedDocuments.isEmpty()
+            && m_merging.removed.isEmpty();
+}
+
+QFuture<bool> BodySearchIndex::Segment::startMerge()
+{
+    // Everything merged must be in the log, so that the merged part of it can be dropped
+    flush();
+    m_mergeOffset = m_deltaSize;
+    m_merging = m_delta;
+    m_delta = Delta();
+
+    m_merge = QtConcurrent::run(&Segment::writeMerged, m_file.fileName(), m_merging);
+    return m_merge;
+}
+
+void BodySearchIndex::Segment::finishMerge(bool merged)
+{
+    if (!merged) {
+        // Fold the newer changes into the merged ones, the next flush tries again
+        Delta delta = m_delta;
+        m_delta = m_merging;
+        m_merging = Delta();
+        for (quint64 id : delta.removed) {
+            if (!delta.addedDocuments.contains(id)) {
+                apply(RemoveRecord, id, QStringList());
+            }
+        }
+        QHash<quint64, QStringList> words;
+        for (auto it = delta.added.constBegin(); it != delta.added.constEnd(); ++it) {
+            for (quint64 id : it.value()) {
+                words[id].append(QString::fromUtf8(it.key()));
+            }
+        }
+        for (quint64 id : delta.addedDocuments) {
+            apply(InsertRecord, id, words.value(id));
+        }
+        return;
+    }
+
+    unmap();
+    map();
+    m_merging = Delta();
+
+    // Records appended during the merge stay in the log
+    QByteArray tail;
+    QFile log(m_deltaFileName);
+    if (log.open(QIODevice::ReadOnly) && log.seek(m_mergeOffset)) {
+        tail = log.readAll();
+    }
+    log.close();
+
+    QSaveFile file(m_deltaFileName);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(tail);
+        if (file.commit()) {
+            m_deltaSize = tail.size();
+            return;
+        }
+    }
+    // Replaying the merged records again on the next start does no harm
+    qCWarning(lcEmail) << "Cannot write body search index log" << m_deltaFileName << file.errorString();
+}
+
+void BodySearchIndex::Segment::discard()
+{
+    m_merge.waitForFinished();
+    unmap();
+    QFile::remove(m_file.fileName());
+    QFile::remove(m_deltaFileName);
+    m_records.clear();
+    m_merging = Delta();
+    m_delta = Delta();
+    m_deltaSize = 0;
+}
+
+BodySearchIndex::BodySearchIndex(QObject *parent)
+    : QObject(parent),
+      m_directory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QLatin1String("/bodyindex")),
+      m_started(false),
+      m_backfilled(false),
+      m_unflushedCount(0)
+{
+    m_indexTimer.setInterval(IndexInterval);
+    connect(&m_indexTimer, SIGNAL(timeout()), this, SLOT(indexPending()));
+
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FlushInterval);
+    connect(&m_flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+BodySearchIndex::~BodySearchIndex()
+{
+    // No merge is started on the way out, the logs are replayed on the next start
+    for (Segment *accountSegment : m_segments) {
+        accountSegment->flush();
+    }
+    qDeleteAll(m_segments);
+}
+
+void BodySearchIndex::start()
+{
+    if (m_started) {
+        return;
+    }
+    m_started = true;
+    QDir().mkpath(m_directory);
+
+    connect(QMailStore::instance(), SIGNAL(accountsRemoved(QMailAccountIdList)),
+            this, SLOT(accountsRemoved(QMailAccountIdList)));
+    connect(QMailStore::instance(), SIGNAL(messagesAdded(QMailMessageIdList)),
+            this, SLOT(messagesAdded(QMailMessageIdList)));
+    connect(QMailStore::instance(), SIGNAL(messagesUpdated(QMailMessageIdList)),
+            this, SLOT(messagesUpdated(QMailMessageIdList)));
+    connect(QMailStore::instance(), SIGNAL(messagesRemoved(QMailMessageIdList)),
+            this, SLOT(messagesRemoved(QMailMessageIdList)));
+    connect(QMailStore::instance(), SIGNAL(messageContentsModified(QMailMessageIdList)),
+            this, SLOT(messageContentsModified(QMailMessageIdList)));
+
+    // Leave scanning the store to the event loop, the search that started
+    // the index falls back to the search action
+    QTimer::singleShot(0, this, SLOT(backfill()));
+}
+
+bool BodySearchIndex::search(const QString &text, QMailMessageIdList *result)
+{
+    start();
+    if (!isComplete()) {
+        return false;
+    }
+
+    const QStringList queryWords = words(text);
+    if (queryWords.isEmpty()) {
+        return false;
+    }
+
+    QSet<quint64> matches;
+    for (int i = 0; i < queryWords.count(); i++) {
+        const QByteArray part = queryWords.at(i).toUtf8();
+        QSet<quint64> wordMatches;
+        for (const Segment *accountSegment : m_segments) {
+            accountSegment->lookup(part, &wordMatches);
+        }
+
+        if (i == 0) {
+            matches = wordMatches;
+        } else {
+            matches.intersect(wordMatches);
+        }
+        if (matches.isEmpty()) {
+            break;
+        }
+    }
+
+    result->clear();
+    result->reserve(matches.count());
+    for (quint64 id : matches) {
+        result->append(QMailMessageId(id));
+    }
+    return true;
+}
+
+bool BodySearchIndex::isExact(const QString &text)
+{
+    if (text.length() < MinWordLength || text.length() > MaxWordLength) {
+        return false;
+    }
+    for (const QChar &c : text) {
+        if (!c.isLetterOrNumber()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BodySearchIndex::bodyContains(const QMailMessageId &id, const QString &text)
+{
+    const QMailMessage message(id);
+    return message.id().isValid() && bodyText(message).contains(text, Qt::CaseInsensitive);
+}
+
+bool BodySearchIndex::isComplete() const
+{
+    return m_backfilled && m_pending.isEmpty();
+}
+
+QStringList BodySearchIndex::words(const QString &text)
+{
+    QStringList result;
+    QSet<QString> seen;
+    const int length = qMin(text.length(), MaxBodyLength);
+    int start = -1;
+
+    for (int i = 0; i <= length; i++) {
+        if (i < length && text.at(i).isLetterOrNumber()) {
+            if (start < 0) {
+                start = i;
+            }
+        } else if (start >= 0) {
+            const int wordLength = i - start;
+            if (wordLength >= MinWordLength) {
+                const QString word = text.mid(start, qMin(wordLength, MaxWordLength)).toLower();
+                if (!seen.contains(word)) {
+                    seen.insert(word);
+                    result.append(word);
+                }
+            }
+            start = -1;
+        }
+    }
+    return result;
+}
+
+void BodySearchIndex::backfill()
+{
+    const QMailAccountIdList accountIds = QMailStore::instance()->queryAccounts();
+    for (const QMailAccountId &accountId : accountIds) {
+        Segment *accountSegment = segment(accountId);
+        const QMailMessageIdList ids = QMailStore::instance()->queryMessages(
+                    QMailMessageKey::parentAccountId(accountId) & contentAvailableKey());
+
+        QSet<quint64> storedIds;
+        QMailMessageIdList missing;
+        storedIds.reserve(ids.count());
+        for (const QMailMessageId &id : ids) {
+            storedIds.insert(id.toULongLong());
+            if (!accountSegment->contains(id.toULongLong())) {
+                missing.append(id);
+            }
+        }
+
+        // Messages removed or emptied while the index was not following the store
+        const QVector<quint64> documents = accountSegment->documents();
+        for (quint64 id : documents) {
+            if (!storedIds.contains(id)) {
+                accountSegment->remove(id);
+            }
+        }
+
+        if (!missing.isEmpty()) {
+            qCDebug(lcEmail) << "Indexing" << missing.count() << "message bodies of account" << accountId;
+            enqueue(missing);
+        }
+    }
+
+    m_backfilled = true;
+    m_flushTimer.start();
+}
+
+void BodySearchIndex::accountsRemoved(const QMailAccountIdList &ids)
+{
+    for (const QMailAccountId &id : ids) {
+        if (Segment *accountSegment = m_segments.take(id)) {
+            accountSegment->discard();
+            delete accountSegment;
+        }
+    }
+}
+
+void BodySearchIndex::messagesAdded(const QMailMessageIdList &ids)
+{
+    enqueue(QMailStore::instance()->queryMessages(QMailMessageKey::id(ids) & contentAvailableKey()));
+}
+
+void BodySearchIndex::messagesUpdated(const QMailMessageIdList &ids)
+{
+    // Mostly flag changes, only pick up messages whose content just became available
+    QMailMessageIdList notIndexed;
+    for (const QMailMessageId &id : ids) {
+        if (!isIndexed(id)) {
+            notIndexed.append(id);
+        }
+    }
+    if (!notIndexed.isEmpty()) {
+        enqueue(QMailStore::instance()->queryMessages(QMailMessageKey::id(notIndexed) & contentAvailableKey()));
+    }
+}
+
+void BodySearchIndex::messagesRemoved(const QMailMessageIdList &ids)
+{
+    for (const QMailMessageId &id : ids) {
+        if (m_pendingIds.remove(id)) {
+            m_pending.removeOne(id);
+        }
+        for (Segment *accountSegment : m_segments) {
+            accountSegment->remove(id.toULongLong());
+        }
+    }
+    m_flushTimer.start();
+}
+
+void BodySearchIndex::messageContentsModified(const QMailMessageIdList &ids)
+{
+    enqueue(ids);
+}
+
+void BodySearchIndex::indexPending()
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+    while (!m_pending.isEmpty() && elapsed.elapsed() < IndexBudget) {
+        const QMailMessageId id = m_pending.takeFirst();
+        m_pendingIds.remove(id);
+        indexMessage(id);
+        m_unflushedCount++;
+    }
+
+    if (m_pending.isEmpty()) {
+        m_indexTimer.stop();
+    }
+    if (m_unflushedCount >= FlushBatchSize) {
+        flush();
+    } else {
+        m_flushTimer.start();
+    }
+}
+
+void BodySearchIndex::flush()
+{
+    m_flushTimer.stop();
+    m_unflushedCount = 0;
+
+    for (auto it = m_segments.constBegin(); it != m_segments.constEnd(); ++it) {
+        if (it.value()->isDirty()) {
+            it.value()->flush();
+        }
+        if (it.value()->needsMerge()) {
+            startMerge(it.key());
+        }
+    }
+}
+
+void BodySearchIndex::startMerge(const QMailAccountId &accountId)
+{
+    QFutureWatcher<bool> *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, accountId] {
+        watcher->deleteLater();
+        // The segment is gone if the account was removed meanwhile
+        if (Segment *accountSegment = m_segments.value(accountId)) {
+            accountSegment->finishMerge(watcher->result());
+        }
+    });
+    watcher->setFuture(m_segments.value(accountId)->startMerge());
+}
+
+BodySearchIndex::Segment *BodySearchIndex::segment(const QMailAccountId &accountId)
+{
+    Segment *accountSegment = m_segments.value(accountId);
+    if (!accountSegment) {
+        accountSegment = new Segment(QStringLiteral("%1/%2.idx").arg(m_directory).arg(accountId.toULongLong()));
+        m_segments.insert(accountId, accountSegment);
+    }
+    return accountSegment;
+}
+
+bool BodySearchIndex::isIndexed(const QMailMessageId &id) const
+{
+    if (m_pendingIds.contains(id)) {
+        return true;
+    }
+    for (const Segment *accountSegment : m_segments) {
+        if (accountSegment->contains(id.toULongLong())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BodySearchIndex::enqueue(const QMailMessageIdList &ids)
+{
+    for (const QMailMessageId &id : ids) {
+        if (!m_pendingIds.contains(id)) {
+            m_pendingIds.insert(id);
+            m_pending.append(id);
+        }
+    }
+
+    if (!m_pending.isEmpty() && !m_indexTimer.isActive()) {
+        m_indexTimer.start();
+    }
+}
+
+void BodySearchIndex::indexMessage(const QMailMessageId &id)
+{
+    const QMailMessage message(id);
+    if (!message.id().isValid() || !message.parentAccountId().isValid()) {
+        return;
+    }
+    if (!(message.status() & (QMailMessage::ContentAvailable | QMailMessage::PartialContentAvailable))) {
+        return;
+    }
+
+    segment(message.parentAccountId())->insert(id.toULongLong(), words(bodyText(message)));
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef BODYSEARCHINDEX_H
+#define BODYSEARCHINDEX_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+
+#include <qmailaccount.h>
+#include <qmailmessage.h>
+
+// Word index over the bodies of the messages having their content on the device.
+// Words of each account are kept in a sidecar file under the cache location which
+// is memory mapped for lookups. Messages indexed after the file was written are held
+// in memory and appended to a log, which is merged into the file on a worker thread
+// once it has grown large. Nothing is done until the first search, from then
+// on the index follows the store signals and backfills the messages stored before
+// it was started, a little at a time.
+class BodySearchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BodySearchIndex(QObject *parent = 0);
+    ~BodySearchIndex();
+
+    // Messages with a body word containing each of the words in text, a superset
+    // of the messages whose body contains text as a case insensitive substring.
+    // Returns false if the index cannot answer, either because it is still
+    // being built or because text has no word long enough to look up.
+    // The first call starts building the index.
+    bool search(const QString &text, QMailMessageIdList *result);
+    bool isComplete() const;
+
+    // True if the result of search() for text is exactly the messages containing
+    // it, which holds when text is a single word. Otherwise the candidates are
+    // checked with bodyContains().
+    static bool isExact(const QString &text);
+    static bool bodyContains(const QMailMessageId &id, const QString &text);
+
+    static QStringList words(const QString &text);
+
+private slots:
+    void backfill();
+    void accountsRemoved(const QMailAccountIdList &ids);
+    void messagesAdded(const QMailMessageIdList &ids);
+    void messagesUpdated(const QMailMessageIdList &ids);
+    void messagesRemoved(const QMailMessageIdList &ids);
+    void messageContentsModified(const QMailMessageIdList &ids);
+    void indexPending();
+    void flush();
+
+private:
+    class Segment;
+
+    void start();
+    Segment *segment(const QMailAccountId &accountId);
+    void startMerge(const QMailAccountId &accountId);
+    bool isIndexed(const QMailMessageId &id) const;
+    void enqueue(const QMailMessageIdList &ids);
+    void indexMessage(const QMailMessageId &id);
+
+    QString m_directory;
+    QHash<QMailAccountId, Segment *> m_segments;
+    QList<QMailMessageId> m_pending;
+    QSet<QMailMessageId> m_pendingIds;
+    bool m_started;
+    bool m_backfilled;
+    int m_unflushedCount;
+    QTimer m_indexTimer;
+    QTimer m_flushTimer;
+};
+
+#endif
@@ -7,8 +7,32 @@
  * http://www.apache.org/licenses/LICENSE-2.0
  */
 
+#include <QHash>
+
 #include "emailaction.h"
 
+template<typename T>
+QList<quint64> idListToValues(const QList<T> &ids)
+{
+    QList<quint64> values;
+    values.reserve(ids.count());
+    for (const typename QList<T>::value_type &id : ids) {
+        values.append(id.toULongLong());
+    }
+    return values;
+}
+
+template<typename T>
+QVariantList idListToVariant(const QList<T> &ids)
+{
+    QVariantList values;
+    values.reserve(ids.count());
+    for (const typename QList<T>::value_type &id : ids) {
+        values.append(id.toULongLong());
+    }
+    return values;
+}
+
 template<typename T>
 QString idListToString(const QList<T> &ids)
 {
@@ -26,13 +50,36 @@ QString idListToString(const QList<T> &ids)
     return idsList;
 }
 
+/*
+  EmailAction::Key
+*/
+EmailAction::Key::Key(const QString &name, const QList<quint64> &values, const QString &text)
+    : name(name)
+    , values(values)
+    , text(text)
+    , hash(::qHash(text, qHashRange(values.constBegin(), values.constEnd(), ::qHash(name))))
+{
+}
+
+bool EmailAction::Key::operator==(const Key &other) const
+{
+    return hash == other.hash && name == other.name && values == other.values && text == other.text;
+}
+
+uint qHash(const EmailAction::Key &key, uint seed)
+{
+    return key.hash ^ seed;
+}
+
 /*
   EmailAction
 */
 EmailAction::EmailAction(bool onlineAction)
     : _description(QString())
     , _type(Export)
+    , _priority(DefaultPriority)
     , _id(0)
+    , _preemptCount(0)
     , _onlineAction(onlineAction)
 {
 }
@@ -46,17 +93,22 @@ QMailAccountId EmailAction::accountId() const
     return QMailAccountId();
 }
 
+QVariantMap EmailAction::parameters() const
+{
+    return QVariantMap();
+}
+
 bool EmailAction::operator==(const EmailAction &action) const
 {
-    if (action._description.isEmpty() || _description.isEmpty()) {
+    if (!action._key.isValid() || !_key.isValid()) {
         return false;
     }
-    return (action._description == _description);
+    return (action._key == _key);
 }
 
 bool EmailAction::operator!=(const EmailAction &action) const
 {
-    return (action._description != _description);
+    return (action._key != _key);
 }
 
 QString EmailAction::description() const
@@ -64,11 +116,65 @@ QString EmailAction::description() const
     return _description;
 }
 
+EmailAction::Key EmailAction::key() const
+{
+    return _key;
+}
+
 EmailAction::ActionType EmailAction::type() const
 {
     return _type;
 }
 
+EmailAction::Priority EmailAction::defaultPriority(ActionType type)
+{
+    switch (type) {
+    case RetrieveMessages:
+    case RetrieveMessagePart:
+    case Search:
+        // Someone is looking at the screen waiting for these
+        return InteractivePriority;
+    case Export:
+    case Retrieve:
+    case RetrieveFolderList:
+    case StandardFolders:
+        return BackgroundPriority;
+    default:
+        return UserInitiatedPriority;
+    }
+}
+
+EmailAction::RetryPolicy EmailAction::retryPolicy(ActionType type)
+{
+    switch (type) {
+    case Search:
+        // Asked again by the user, results coming late would be confusing
+        return RetryPolicy(0, 0, 0);
+    case RetrieveMessages:
+    case RetrieveMessagePart:
+        // Someone is waiting, give up soon
+        return RetryPolicy(2, 1000, 4000);
+    case Retrieve:
+    case RetrieveFolderList:
+    case StandardFolders:
+        // The next sync catches up anyway
+        return RetryPolicy(3, 10000, 120000);
+    default:
+        // Sends and local changes are lost for the server otherwise
+        return RetryPolicy(6, 5000, 300000);
+    }
+}
+
+EmailAction::Priority EmailAction::priority() const
+{
+    return _priority == DefaultPriority ? defaultPriority(_type) : _priority;
+}
+
+void EmailAction::setPriority(Priority priority)
+{
+    _priority = priority;
+}
+
 quint64 EmailAction::id() const
 {
     return _id;
@@ -79,6 +185,16 @@ void EmailAction::setId(const quint64 id)
     _id = id;
 }
 
+int EmailAction::preemptCount() const
+{
+    return _preemptCount;
+}
+
+void EmailAction::setPreemptCount(int count)
+{
+    _preemptCount = count;
+}
+
 /*
   CreateStandardFolders
 */
@@ -88,6 +204,7 @@ CreateStandardFolders::CreateStandardFolders(QMailRetrievalAction *retrievalActi
     , _accountId(id)
 {
     _description = QString("create-standard-folders:account-id=%1").arg(_accountId.toULongLong());
+    _key = Key(QStringLiteral("create-standard-folders"), QList<quint64>() << _accountId.toULongLong());
     _type = EmailAction::StandardFolders;
 }
 
@@ -120,6 +237,7 @@ DeleteMessages::DeleteMessages(QMailStorageAction* storageAction, const QMailMes
 {
     QString idsList = idListToString(_ids);
     _description = QString("delete-messages:message-ids=%1").arg(idsList);
+    _key = Key(QStringLiteral("delete-messages"), idListToValues(_ids));
     _type = EmailAction::Storage;
 }
 
@@ -137,6 +255,13 @@ QMailServiceAction* DeleteMessages::serviceAction() const
     return _storageAction;
 }
 
+QVariantMap DeleteMessages::parameters() const
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("messageIds"), idListToVariant(_ids));
+    return parameters;
+}
+
 /*
   ExportUpdates
 */
@@ -146,6 +271,7 @@ ExportUpdates::ExportUpdates(QMailRetrievalAction *retrievalAction, const QMailA
     , _accountId(id)
 {
     _description = QString("exporting-updates:account-id=%1").arg(_accountId.toULongLong());
+    _key = Key(QStringLiteral("exporting-updates"), QList<quint64>() << _accountId.toULongLong());
     _type = EmailAction::Export;
 }
 
@@ -163,6 +289,13 @@ QMailServiceAction* ExportUpdates::serviceAction() const
     return _retrievalAction;
 }
 
+QVariantMap ExportUpdates::parameters() const
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("accountId"), _accountId.toULongLong());
+    return parameters;
+}
+
 QMailAccountId ExportUpdates::accountId() const
 {
     return _accountId;
@@ -182,6 +315,7 @@ FlagMessages::FlagMessages(QMailStorageAction* storageAction, const QMailMessage
     QString idsList = idListToString(_ids);
     _description = QString("flag-messages:message-ids=%1;setMark=%2;unsetMark=%3").arg(idsList)
             .arg(_setMask).arg(_unsetMask);
+    _key = Key(QStringLiteral("flag-messages"), idListToValues(_ids) << _setMask << _unsetMask);
     _type = EmailAction::Storage;
 }
 
@@ -199,6 +333,16 @@ QMailServiceAction* FlagMessages::serviceAction() const
     return _storageAction;
 }
 
+QVariantMap FlagMessages::parameters() const
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("messageIds"), idListToVariant(_ids));
+    // Status bits can go beyond the integers JSON holds exactly
+    parameters.insert(QStringLiteral("setMask"), QString::number(_setMask));
+    parameters.insert(QStringLiteral("unsetMask"), QString::number(_unsetMask));
+    return parameters;
+}
+
 /*
     MoveToFolder
 */
@@ -212,6 +356,7 @@ MoveToFolder::MoveToFolder(QMailStorageAction *storageAction, const QMailMessage
     QString idsList = idListToString(_ids);
     _description = QString("move-messages-to-folder:message-ids=%1;folder-id=%2").arg(idsList)
             .arg(_destinationFolder.toULongLong());
+    _key = Key(QStringLiteral("move-messages-to-folder"), idListToValues(_ids) << _destinationFolder.toULongLong());
     _type = EmailAction::Storage;
 }
 
@@ -229,6 +374,14 @@ QMailServiceAction* MoveToFolder::serviceAction() const
     return _storageAction;
 }
 
+QVariantMap MoveToFolder::parameters() const
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("messageIds"), idListToVariant(_ids));
+    parameters.insert(QStringLiteral("folderId"), _destinationFolder.toULongLong());
+    return parameters;
+}
+
 /*
    MoveToStandardFolder
 */
@@ -242,6 +395,7 @@ MoveToStandardFolder::MoveToStandardFolder(QMailStorageAction *storageAction,
     QString idsList = idListToString(_ids);
     _description = QString("move-messages-to-standard-folder:message-ids=%1;standard-folder=%2").arg(idsList)
             .arg(_standardFolder);
+    _key = Key(QStringLiteral("move-messages-to-standard-folder"), idListToValues(_ids) << quint64(_standardFolder));
     _type = EmailAction::Storage;
 }
 
@@ -278,6 +432,7 @@ OnlineCreateFolder::OnlineCreateFolder(QMailStorageAction* storageAction, const
     }
     _description = QString("create-folder:name=%1;account-id=%2;parent-id=%3").arg(_accountId.toULongLong())
             .arg(_name).arg(pId);
+    _key = Key(QStringLiteral("create-folder"), QList<quint64>() << _accountId.toULongLong() << _parentId.toULongLong(), _name);
     _type = EmailAction::OnlineCreateFolder;
 }
 
@@ -295,6 +450,15 @@ QMailServiceAction* OnlineCreateFolder::serviceAction() const
     return _storageAction;
 }
 
+QVariantMap OnlineCreateFolder::parameters() const
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("name"), _name);
+    parameters.insert(QStringLiteral("accountId"), _accountId.toULongLong());
+    parameters.insert(QStringLiteral("parentId"), _parentId.toULongLong());
+    return parameters;
+}
+
 QMailAccountId OnlineCreateFolder::accountId() const
 {
     return _accountId;
@@ -309,6 +473,7 @@ OnlineDeleteFolder::OnlineDeleteFolder(QMailStorageAction* storageAction, const
     , _folderId(folderId)
 {
     _description = QString("delete-folder:folder-id=%1").arg(_folderId.toULongLong());
+    _key = Key(QStringLiteral("delete-folder"), QList<quint64>() << _folderId.toULongLong());
     _type = EmailAction::OnlineDeleteFolder;
 }
 
@@ -326,6 +491,13 @@ QMailServiceAction* OnlineDeleteFolder::serviceAction() const
     return _storageAction;
 }
 
+QVariantMap OnlineDeleteFolder::parameters() const
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("folderId"), _folderId.toULongLong());
+    return parameters;
+}
+
 QMailAccountId OnlineDeleteFolder::accountId() const
 {
     QMailFolder folder(_folderId);
@@ -345,6 +517,7 @@ OnlineMoveMessages::OnlineMoveMessages(QMailStorageAction *storageAction, const
     QString idsList = idListToString(_ids);
     _description = QString("move-messages:message-ids=%1;destination-folder=%2").arg(idsList)
             .arg(_destinationId.toULongLong());
+    _key = Key(QStringLiteral("move-messages"), idListToValues(_ids) << _destinationId.toULongLong());
     _type = EmailAction::Storage;
 }
 
@@ -372,6 +545,7 @@ OnlineRenameFolder::OnlineRenameFolder(QMailStorageAction* storageAction, const
     , _name(name)
 {
     _description = QString("rename-folder:folder-id=%1;new-name=%2").arg(_folderId.toULongLong()).arg(_name);
+    _key = Key(QStringLiteral("rename-folder"), QList<quint64>() << _folderId.toULongLong(), _name);
     _type = EmailAction::OnlineRenameFolder;
 }
 
@@ -389,6 +563,14 @@ QMailServiceAction* OnlineRenameFolder::serviceAction() const
     return _storageAction;
 }
 
+QVariantMap OnlineRenameFolder::parameters() const
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("folderId"), _folderId.toULongLong());
+    parameters.insert(QStringLiteral("name"), _name);
+    return parameters;
+}
+
 QMailAccountId OnlineRenameFolder::accountId() const
 {
     QMailFolder folder(_folderId);
@@ -405,6 +587,7 @@ OnlineMoveFolder::OnlineMoveFolder(QMailStorageAction* storageAction, const QMai
     , _newParentId(newParentId)
 {
     _description = QString("move-folder:folder-id=%1;new-parent=%2").arg(_folderId.toULongLong()).arg(_newParentId.toULongLong());
+    _key = Key(QStringLiteral("move-folder"), QList<quint64>() << _folderId.toULongLong() << _newParentId.toULongLong());
     _type = EmailAction::OnlineMoveFolder;
 }
 
@@ -422,6 +605,14 @@ QMailServiceAction* OnlineMoveFolder::serviceAction() const
     return _storageAction;
 }
 
+QVariantMap OnlineMoveFolder::parameters() const
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("folderId"), _folderId.toULongLong());
+    parameters.insert(QStringLiteral("parentId"), _newParentId.toULongLong());
+    return parameters;
+}
+
 QMailAccountId OnlineMoveFolder::accountId() const
 {
     QMailFolder folder(_folderId);
@@ -448,6 +639,7 @@ RetrieveFolderList::RetrieveFolderList(QMailRetrievalAction* retrievalAction, co
     _description = QString("retrieve-folder-list:account-id=%1;folder-id=%2")
             .arg(_accountId.toULongLong())
             .arg(fId);
+    _key = Key(QStringLiteral("retrieve-folder-list"), QList<quint64>() << _accountId.toULongLong() << _folderId.toULongLong());
     _type = EmailAction::RetrieveFolderList;
 }
 
@@ -485,6 +677,7 @@ RetrieveMessageList::RetrieveMessageList(QMailRetrievalAction* retrievalAction,
     _description = QString("retrieve-message-list:account-id=%1;folder-id=%2")
             .arg(_accountId.toULongLong())
             .arg(_folderId.toULongLong());
+    _key = Key(QStringLiteral("retrieve-message-list"), QList<quint64>() << _accountId.toULongLong() << _folderId.toULongLong());
     _type = EmailAction::Retrieve;
 }
 
@@ -523,6 +716,7 @@ RetrieveMessageLists::RetrieveMessageLists(QMailRetrievalAction* retrievalAction
     _description = QString("retrieve-message-lists:account-id=%1;folder-ids=%2")
             .arg(_accountId.toULongLong())
             .arg(ids);
+    _key = Key(QStringLiteral("retrieve-message-lists"), idListToValues(_folderIds) << _accountId.toULongLong());
     _type = EmailAction::Retrieve;
 }
 
@@ -559,6 +753,7 @@ RetrieveMessagePart::RetrieveMessagePart(QMailRetrievalAction *retrievalAction,
 {
     _description = QString("retrieve-message-part:partLocation-id=%1")
             .arg(_partLocation.toString(true));
+    _key = Key(QStringLiteral("retrieve-message-part"), QList<quint64>(), _partLocation.toString(true));
     _type = EmailAction::RetrieveMessagePart;
 }
 
@@ -586,6 +781,16 @@ QMailServiceAction* RetrieveMessagePart::serviceAction() const
     return _retrievalAction;
 }
 
+QVariantMap RetrieveMessagePart::parameters() const
+{
+    // Parts shown inline are asked again when the message is opened
+    QVariantMap parameters;
+    if (_isAttachment) {
+        parameters.insert(QStringLiteral("location"), _partLocation.toString(true));
+    }
+    return parameters;
+}
+
 bool RetrieveMessagePart::isAttachment() const
 {
     return _isAttachment;
@@ -610,6 +815,7 @@ RetrieveMessagePartRange::RetrieveMessagePartRange(QMailRetrievalAction *retriev
     _description = QString("retrieve-message-part:partLocation-id=%1;minimumBytes=%2")
             .arg(_partLocation.toString(true))
             .arg(_minimum);
+    _key = Key(QStringLiteral("retrieve-message-part-range"), QList<quint64>() << _minimum, _partLocation.toString(true));
     _type = EmailAction::Retrieve;
 }
 
@@ -646,6 +852,7 @@ RetrieveMessageRange::RetrieveMessageRange(QMailRetrievalAction *retrievalAction
     _description = QString("retrieve-message-range:message-id=%1;minimumBytes=%2")
             .arg(_messageId.toULongLong())
             .arg(_minimum);
+    _key = Key(QStringLiteral("retrieve-message-range"), QList<quint64>() << _messageId.toULongLong() << _minimum);
     _type = EmailAction::Retrieve;
 }
 
@@ -682,6 +889,7 @@ RetrieveMessages::RetrieveMessages(QMailRetrievalAction *retrievalAction,
 {
     QString idsList = idListToString(_messageIds);
     _description = QString("retrieve-messages:message-ids=%1").arg(idsList);
+    _key = Key(QStringLiteral("retrieve-messages"), idListToValues(_messageIds));
     _type = EmailAction::RetrieveMessages;
 }
 
@@ -720,6 +928,7 @@ SearchMessages::SearchMessages(QMailSearchAction *searchAction,
     , _searchBody(searchBody)
 {
     _description = QString("search-messages:body-text=%1").arg(bodyText);
+    _key = Key(QStringLiteral("search-messages"), QList<quint64>(), bodyText);
     _type = EmailAction::Search;
 }
 
@@ -761,6 +970,7 @@ Synchronize::Synchronize(QMailRetrievalAction* retrievalAction, const QMailAccou
         , _minimum(minimum)
 {
     _description = QString("synchronize:account-id=%1").arg(_accountId.toULongLong());
+    _key = Key(QStringLiteral("synchronize"), QList<quint64>() << _accountId.toULongLong());
     _type = EmailAction::Retrieve;
 }
 
@@ -792,6 +1002,7 @@ TransmitMessage::TransmitMessage(QMailTransmitAction* transmitAction, const QMai
     , _messageId(messageId)
 {
     _description = QString("transmit-message:message-id=%1").arg(_messageId.toULongLong());
+    _key = Key(QStringLiteral("transmit-message"), QList<quint64>() << _messageId.toULongLong());
     _type = EmailAction::Transmit;
 }
 
@@ -809,6 +1020,13 @@ QMailServiceAction* TransmitMessage::serviceAction() const
     return _transmitAction;
 }
 
+QVariantMap TransmitMessage::parameters() const
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("messageId"), _messageId.toULongLong());
+    return parameters;
+}
+
 QMailMessageId TransmitMessage::messageId() const
 {
     return _messageId;
@@ -829,6 +1047,7 @@ TransmitMessages::TransmitMessages(QMailTransmitAction* transmitAction, const QM
     , _accountId(id)
 {
     _description = QString("transmit-messages:account-id=%1").arg(_accountId.toULongLong());
+    _key = Key(QStringLiteral("transmit-messages"), QList<quint64>() << _accountId.toULongLong());
     _type = EmailAction::Transmit;
 }
 
@@ -846,6 +1065,13 @@ QMailServiceAction* TransmitMessages::serviceAction() const
     return _transmitAction;
 }
 
+QVariantMap TransmitMessages::parameters() const
+{
+    QVariantMap parameters;
+    parameters.insert(QStringLiteral("accountId"), _accountId.toULongLong());
+    return parameters;
+}
+
 QMailAccountId TransmitMessages::accountId() const
 {
     return _accountId;
@@ -865,6 +1091,9 @@ EasInvitationResponse::EasInvitationResponse(QMailProtocolAction* protocolAction
     , _responseData(responseData)
 {
     _description = QString("eas-invitation-response=%1").arg(_responseData.toString());
+    _key = Key(QStringLiteral("eas-invitation-response"),
+               QList<quint64>() << _accountId.toULongLong() << quint64(_response)
+                                << _responseData.toMap().value(QStringLiteral("messageId")).toULongLong());
     _type = EmailAction::CalendarInvitationResponse;
 }
 
@@ -10,7 +10,9 @@
 #ifndef EMAILACTION_H
 #define EMAILACTION_H
 
+#include <QList>
 #include <QObject>
+#include <QVariantMap>
 #include <qmailserviceaction.h>
 
 class Q_DECL_EXPORT EmailAction : public QObject
@@ -36,29 +38,79 @@ public:
         OnlineMoveFolder
     };
 
+    // Queued actions run by priority, in queue order within a priority
+    enum Priority {
+        DefaultPriority = -1,
+        BackgroundPriority = 0,
+        UserInitiatedPriority,
+        InteractivePriority
+    };
+
+    // How often and how soon an action failing on the connection is tried again
+    struct RetryPolicy {
+        RetryPolicy(int maximumAttempts, int initialDelay, int maximumDelay)
+            : maximumAttempts(maximumAttempts), initialDelay(initialDelay), maximumDelay(maximumDelay) {}
+
+        int maximumAttempts;
+        // Milliseconds before the first retry, doubled for each further one up to maximumDelay
+        int initialDelay;
+        int maximumDelay;
+    };
+
+    // Identifies the request, an action with the same key as a queued one is a duplicate
+    struct Key {
+        Key() : hash(0) {}
+        Key(const QString &name, const QList<quint64> &values, const QString &text = QString());
+
+        bool isValid() const { return !name.isEmpty(); }
+        bool operator==(const Key &other) const;
+        bool operator!=(const Key &other) const { return !(*this == other); }
+
+        QString name;
+        QList<quint64> values;
+        QString text;
+        uint hash;
+    };
+
     virtual ~EmailAction();
     virtual void execute() = 0;
     virtual QMailAccountId accountId() const;
     virtual QMailServiceAction* serviceAction() const = 0;
+    // What is needed to queue the action again after a restart, empty for
+    // actions not worth resuming
+    virtual QVariantMap parameters() const;
     bool operator==(const EmailAction &action) const;
     bool operator!=(const EmailAction &action) const;
     QString description() const;
+    Key key() const;
     ActionType type() const;
+    static Priority defaultPriority(ActionType type);
+    static RetryPolicy retryPolicy(ActionType type);
+    Priority priority() const;
+    void setPriority(Priority priority);
     quint64 id() const;
     void setId(const quint64 id);
+    // Times the action gave way to an interactive one and was run again
+    int preemptCount() const;
+    void setPreemptCount(int count);
     bool needsNetworkConnection() const { return _onlineAction; }
 
 protected:
     EmailAction(bool onlineAction = true);
 
     QString _description;
+    Key _key;
     ActionType _type;
+    Priority _priority;
     quint64 _id;
+    int _preemptCount;
 
 private:
     bool _onlineAction;
 };
 
+Q_DECL_EXPORT uint qHash(const EmailAction::Key &key, uint seed = 0);
+
 class CreateStandardFolders : public EmailAction
 {
 public:
@@ -80,6 +132,7 @@ public:
     ~DeleteMessages();
     void execute();
     QMailServiceAction* serviceAction() const;
+    QVariantMap parameters() const;
 
 private:
     QMailStorageAction* _storageAction;
@@ -93,6 +146,7 @@ public:
     ~ExportUpdates();
     void execute();
     QMailServiceAction* serviceAction() const;
+    QVariantMap parameters() const;
     QMailAccountId accountId() const;
 
 private:
@@ -108,6 +162,7 @@ public:
     ~FlagMessages();
     void execute();
     QMailServiceAction* serviceAction() const;
+    QVariantMap parameters() const;
 
 private:
     QMailStorageAction* _storageAction;
@@ -124,6 +179,7 @@ public:
     ~MoveToFolder();
     void execute();
     QMailServiceAction* serviceAction() const;
+    QVariantMap parameters() const;
 
 private:
     QMailStorageAction* _storageAction;
@@ -154,6 +210,7 @@ public:
     ~OnlineCreateFolder();
     void execute();
     QMailServiceAction* serviceAction() const;
+    QVariantMap parameters() const;
     QMailAccountId accountId() const;
 
 private:
@@ -171,6 +228,7 @@ public:
     ~OnlineDeleteFolder();
     void execute();
     QMailServiceAction* serviceAction() const;
+    QVariantMap parameters() const;
     QMailAccountId accountId() const;
 
 private:
@@ -201,6 +259,7 @@ public:
     ~OnlineRenameFolder();
     void execute();
     QMailServiceAction* serviceAction() const;
+    QVariantMap parameters() const;
     QMailAccountId accountId() const;
 
 private:
@@ -217,6 +276,7 @@ public:
     ~OnlineMoveFolder();
     void execute();
     QMailServiceAction* serviceAction() const;
+    QVariantMap parameters() const;
     QMailAccountId accountId() const;
 
 private:
@@ -289,6 +349,7 @@ public:
     void execute();
     QMailMessageId messageId() const;
     QMailServiceAction* serviceAction() const;
+    QVariantMap parameters() const;
     QString partLocation() const;
     bool isAttachment() const;
     QMailAccountId accountId() const;
@@ -394,6 +455,7 @@ public:
     ~TransmitMessage();
     void execute();
     QMailServiceAction* serviceAction() const;
+    QVariantMap parameters() const;
     QMailMessageId messageId() const;
     QMailAccountId accountId() const;
 
@@ -409,6 +471,7 @@ public:
     ~TransmitMessages();
     void execute();
     QMailServiceAction* serviceAction() const;
+    QVariantMap parameters() const;
     QMailAccountId accountId() const;
 
 private:
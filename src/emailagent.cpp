@@ -9,14 +9,20 @@
  */
 
 
+#include <algorithm>
+#include <limits>
+
+#include <QDateTime>
 #include <QDBusInterface>
 #include <QDBusObjectPath>
 #include <QDBusPendingCallWatcher>
 #include <QDBusPendingReply>
 #include <QFile>
+#include <QGuiApplication>
 #include <QMap>
 #include <QStandardPaths>
 #include <QNetworkConfigurationManager>
+#include <QTimer>
 
 #include <qmailnamespace.h>
 #include <qmailaccount.h>
@@ -25,6 +31,12 @@
 
 #include "emailagent.h"
 #include "emailaction.h"
+#include "actionjournal.h"
+#include "actionstatistics.h"
+#include "bodysearchindex.h"
+#include "headersearchindex.h"
+#include "messagefieldwriter.h"
+#include "searchcoordinator.h"
 #include "emailutils.h"
 #include "folderutils.h"
 #include "folderaccessor.h"
@@ -36,10 +48,63 @@
 
 namespace {
 
+const int DefaultExportUpdatesDelay = 2000;
+// Continuous changes still get exported after this many delays
+const int MaximumExportDelayFactor = 5;
+// Journaled actions older than this are not resumed, the next sync catches up
+const qint64 MaximumJournalAge = 24 * 60 * 60 * 1000;
+const int DefaultAccountsSyncConcurrency = 3;
+// Accounts last synchronized within this many seconds of each other go by their unread messages
+const qint64 SyncAgeGranularity = 5 * 60;
+// A background action gives way this many times at most, after that it runs to the end
+const int MaximumPreemptions = 1;
+// Candidates of a body index search loaded to check the text, beyond this the search action runs instead
+const int MaximumBodyVerifications = 200;
+
 QMailAccountId accountForMessageId(const QMailMessageId &msgId)
 {
-    QMailMessageMetaData metaData(msgId);
-    return metaData.parentAccountId();
+    // Only the account is needed, skip loading the rest of the metadata
+    const QMailMessageMetaDataList metaDataList
+            = QMailStore::instance()->messagesMetaData(QMailMessageKey::id(msgId), QMailMessageKey::ParentAccountId);
+    return metaDataList.isEmpty() ? QMailAccountId() : metaDataList.first().parentAccountId();
+}
+
+QMailAccountId accountForFolderId(const QMailFolderId &folderId)
+{
+    QMailFolder folder(folderId);
+    return folder.parentAccountId();
+}
+
+// The indexes and the field writer follow the store on their own and keep
+// files of their own, there is one of each per process however many agents
+// QML creates. They go away with the application.
+BodySearchIndex *sharedBodySearchIndex()
+{
+    static BodySearchIndex *index = new BodySearchIndex(QCoreApplication::instance());
+    return index;
+}
+
+HeaderSearchIndex *sharedHeaderSearchIndex()
+{
+    static HeaderSearchIndex *index = new HeaderSearchIndex(QCoreApplication::instance());
+    return index;
+}
+
+MessageFieldWriter *sharedMessageFieldWriter()
+{
+    static MessageFieldWriter *writer = new MessageFieldWriter(QCoreApplication::instance());
+    return writer;
+}
+
+// Action ids are only unique within an agent, so the journal belongs to the
+// first agent created and the actions of any other one are not journaled
+EmailAgent *journalOwner = 0;
+
+ActionJournal *sharedActionJournal()
+{
+    static ActionJournal journal(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+                                 + QLatin1String("/actions.journal"));
+    return &journal;
 }
 }
 
@@ -56,55 +121,91 @@ EmailAgent::EmailAgent(QObject *parent)
     : QObject(parent)
     , m_actionCount(0)
     , m_accountSynchronizing(0)
-    , m_transmitting(false)
-    , m_cancellingSingleAction(false)
     , m_synchronizing(false)
     , m_enqueing(false)
-    , m_retrievalAction(new QMailRetrievalAction(this))
-    , m_storageAction(new QMailStorageAction(this))
-    , m_transmitAction(new QMailTransmitAction(this))
+    , m_preemptBackground(true)
     , m_searchAction(new QMailSearchAction(this))
-    , m_protocolAction(new QMailProtocolAction(this))
+    , m_bodySearchIndex(sharedBodySearchIndex())
+    , m_headerSearchIndex(sharedHeaderSearchIndex())
+    , m_messageFieldWriter(sharedMessageFieldWriter())
+    , m_searchCoordinator(new SearchCoordinator(this))
+    , m_searchGeneration(0)
+    , m_searchActionGeneration(0)
     , m_nmanager(new QNetworkConfigurationManager(this))
+    , m_localLane(0)
+    , m_exportTimer(new QTimer(this))
+    , m_exportUpdatesDelay(DefaultExportUpdatesDelay)
+    , m_savedExports(0)
+    , m_journal(journalOwner ? 0 : sharedActionJournal())
+    , m_journalCreated(0)
+    , m_statistics(new ActionStatistics(this))
+    , m_retryTimer(new QTimer(this))
+    , m_accountsSyncConcurrency(DefaultAccountsSyncConcurrency)
+    , m_syncAccountCount(0)
+    , m_syncedAccountCount(0)
 {
     connect(QMailStore::instance(), SIGNAL(ipcConnectionEstablished()),
             this, SLOT(onIpcConnectionEstablished()));
+    connect(QMailStore::instance(), SIGNAL(accountsRemoved(QMailAccountIdList)),
+            this, SLOT(onAccountsRemoved(QMailAccountIdList)));
 
     initMailServer();
     setupAccountFlags();
 
-    connect(m_transmitAction.data(), SIGNAL(progressChanged(uint, uint)),
-            this, SLOT(progressChanged(uint,uint)));
-
-    connect(m_retrievalAction.data(), SIGNAL(activityChanged(QMailServiceAction::Activity)),
-            this, SLOT(activityChanged(QMailServiceAction::Activity)));
-
-    connect(m_retrievalAction.data(), SIGNAL(progressChanged(uint, uint)),
-            this, SLOT(progressChanged(uint,uint)));
-
-    connect(m_storageAction.data(), SIGNAL(activityChanged(QMailServiceAction::Activity)),
-            this, SLOT(activityChanged(QMailServiceAction::Activity)));
-
-    connect(m_transmitAction.data(), SIGNAL(activityChanged(QMailServiceAction::Activity)),
-            this, SLOT(activityChanged(QMailServiceAction::Activity)));
+    // Searches are not bound to an account, they share the local lane
+    m_localLane = createLane(QMailAccountId());
+    m_serviceActionLanes.insert(m_searchAction.data(), m_localLane);
 
     connect(m_searchAction.data(), SIGNAL(activityChanged(QMailServiceAction::Activity)),
             this, SLOT(activityChanged(QMailServiceAction::Activity)));
 
-    connect(m_protocolAction.data(), SIGNAL(activityChanged(QMailServiceAction::Activity)),
-            this, SLOT(activityChanged(QMailServiceAction::Activity)));
-
     connect(m_searchAction.data(), SIGNAL(messageIdsMatched(const QMailMessageIdList&)),
+            this, SLOT(onSearchMessageIdsMatched(const QMailMessageIdList&)));
+
+    connect(m_searchCoordinator, SIGNAL(messageIdsMatched(const QMailMessageIdList&)),
             this, SIGNAL(searchMessageIdsMatched(const QMailMessageIdList&)));
+    connect(m_searchCoordinator, SIGNAL(accountSearchCompleted(QString,QMailAccountId,QMailMessageIdList,int)),
+            this, SIGNAL(searchAccountCompleted(QString,QMailAccountId,QMailMessageIdList,int)));
+    connect(m_searchCoordinator, SIGNAL(searchCompleted(QString,QMailMessageIdList,int,bool)),
+            this, SLOT(onRemoteSearchCompleted(QString,QMailMessageIdList,int,bool)));
 
     connect(m_nmanager, SIGNAL(onlineStateChanged(bool)), this, SLOT(onOnlineStateChanged(bool)));
 
+    m_exportTimer->setSingleShot(true);
+    connect(m_exportTimer, SIGNAL(timeout()), this, SLOT(exportPendingUpdates()));
+    m_exportClock.start();
+    m_retryTimer->setSingleShot(true);
+    connect(m_retryTimer, SIGNAL(timeout()), this, SLOT(retryFailedActions()));
+    m_retryClock.start();
+    // Pending exports are sent right away when the application goes to background
+    if (QGuiApplication *application = qobject_cast<QGuiApplication *>(QCoreApplication::instance())) {
+        connect(application, SIGNAL(applicationStateChanged(Qt::ApplicationState)),
+                this, SLOT(onApplicationStateChanged(Qt::ApplicationState)));
+    }
+
     m_waitForIpc = !QMailStore::instance()->isIpcConnectionEstablished();
     m_instance = this;
+
+    if (m_journal) {
+        journalOwner = this;
+        replayJournal();
+    }
 }
 
 EmailAgent::~EmailAgent()
 {
+    // Delayed exports would be lost, the next start runs them from the journal
+    for (const QMailAccountId &accountId : m_pendingExports.keys()) {
+        ExportUpdates action(0, accountId);
+        action.setId(newAction());
+        journalAction(&action);
+    }
+
+    qDeleteAll(m_accountLanes);
+    delete m_localLane;
+    if (journalOwner == this) {
+        journalOwner = 0;
+    }
 }
 
 int EmailAgent::currentSynchronizingAccountId() const
@@ -180,24 +281,128 @@ QString EmailAgent::bodyPlainText(const QMailMessage &mailMsg) const
 void EmailAgent::cancelAction(quint64 actionId)
 {
     // cancel running action
-    if (m_currentAction && (m_currentAction->id() == actionId)) {
-        cancelCurrentAction();
-    } else {
-        removeAction(actionId);
+    for (ActionLane *lane : lanes()) {
+        if (lane->currentAction && (lane->currentAction->id() == actionId)) {
+            cancelCurrentAction(lane);
+            return;
+        }
     }
+    removeAction(actionId);
 }
 
-quint64 EmailAgent::downloadMessages(const QMailMessageIdList &messageIds, QMailRetrievalAction::RetrievalSpecification spec)
+quint64 EmailAgent::downloadMessages(const QMailMessageIdList &messageIds, QMailRetrievalAction::RetrievalSpecification spec,
+                                     EmailAction::Priority priority)
 {
-    return enqueue(new RetrieveMessages(m_retrievalAction.data(), messageIds, spec));
+    // Messages of several accounts are retrieved on the local lane
+    const QMailAccountIdList accountIds = accountIdsForMessages(QMailMessageKey::id(messageIds));
+    const QMailAccountId accountId = accountIds.count() == 1 ? accountIds.first() : QMailAccountId();
+    return enqueue(new RetrieveMessages(retrievalAction(accountId), messageIds, spec), priority);
 }
 
-quint64 EmailAgent::downloadMessagePart(const QMailMessagePart::Location &location)
+quint64 EmailAgent::downloadMessagePart(const QMailMessagePart::Location &location, EmailAction::Priority priority)
 {
-    return enqueue(new RetrieveMessagePart(m_retrievalAction.data(), location, false));
+    QMailAccountId accountId = accountForMessageId(location.containingMessageId());
+    return enqueue(new RetrieveMessagePart(retrievalAction(accountId), location, false), priority);
 }
 
 void EmailAgent::exportUpdates(const QMailAccountIdList &accountIdList)
+{
+    if (m_exportUpdatesDelay <= 0) {
+        enqueueExportUpdates(accountIdList);
+        return;
+    }
+
+    const qint64 now = m_exportClock.elapsed();
+    for (const QMailAccountId &accountId : accountIdList) {
+        QHash<QMailAccountId, PendingExport>::iterator it = m_pendingExports.find(accountId);
+        if (it == m_pendingExports.end()) {
+            PendingExport pending;
+            pending.firstRequest = now;
+            pending.due = now + m_exportUpdatesDelay;
+            m_pendingExports.insert(accountId, pending);
+        } else {
+            it->due = qMin(now + m_exportUpdatesDelay,
+                           it->firstRequest + qint64(MaximumExportDelayFactor) * m_exportUpdatesDelay);
+            m_savedExports++;
+            emit savedExportsChanged();
+        }
+    }
+    scheduleExportTimer();
+
+    // Callers hold back their actions until the exports are queued
+    if (m_enqueing) {
+        m_enqueing = false;
+        startLanes();
+    }
+}
+
+int EmailAgent::exportUpdatesDelay() const
+{
+    return m_exportUpdatesDelay;
+}
+
+void EmailAgent::setExportUpdatesDelay(int milliseconds)
+{
+    m_exportUpdatesDelay = qMax(0, milliseconds);
+    if (m_exportUpdatesDelay == 0) {
+        flushPendingExports();
+    }
+}
+
+int EmailAgent::savedExports() const
+{
+    return m_savedExports;
+}
+
+void EmailAgent::flushPendingExports()
+{
+    const QMailAccountIdList accountIdList = m_pendingExports.keys();
+    m_pendingExports.clear();
+    m_exportTimer->stop();
+    enqueueExportUpdates(accountIdList);
+}
+
+void EmailAgent::exportPendingUpdates()
+{
+    const qint64 now = m_exportClock.elapsed();
+    QMailAccountIdList accountIdList;
+    for (QHash<QMailAccountId, PendingExport>::iterator it = m_pendingExports.begin(); it != m_pendingExports.end();) {
+        if (it->due <= now) {
+            accountIdList.append(it.key());
+            it = m_pendingExports.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    enqueueExportUpdates(accountIdList);
+    scheduleExportTimer();
+}
+
+void EmailAgent::scheduleExportTimer()
+{
+    if (m_pendingExports.isEmpty()) {
+        m_exportTimer->stop();
+        return;
+    }
+
+    qint64 due = m_pendingExports.constBegin()->due;
+    for (const PendingExport &pending : m_pendingExports) {
+        due = qMin(due, pending.due);
+    }
+    m_exportTimer->start(int(qMax(qint64(0), due - m_exportClock.elapsed())));
+}
+
+void EmailAgent::dropPendingExport(const QMailAccountId &accountId)
+{
+    // Synchronizing exports the changes as well
+    if (m_pendingExports.remove(accountId)) {
+        m_savedExports++;
+        emit savedExportsChanged();
+        scheduleExportTimer();
+    }
+}
+
+void EmailAgent::enqueueExportUpdates(const QMailAccountIdList &accountIdList)
 {
     if (!m_enqueing && accountIdList.size()) {
         m_enqueing = true;
@@ -206,7 +411,7 @@ void EmailAgent::exportUpdates(const QMailAccountIdList &accountIdList)
         if (i+1 == accountIdList.size()) {
             m_enqueing = false;
         }
-        enqueue(new ExportUpdates(m_retrievalAction.data(), accountIdList.at(i)));
+        enqueue(new ExportUpdates(retrievalAction(accountIdList.at(i)), accountIdList.at(i)));
     }
 }
 
@@ -280,32 +485,171 @@ void EmailAgent::searchMessages(const QMailMessageKey &filter,
     // Only one search action should be running at time,
     // cancel any running or queued
     cancelSearch();
+
+    if (spec == QMailSearchAction::Local && searchBody && searchBodyIndex(filter, bodyText, limit, sort)) {
+        return;
+    }
+
     qCDebug(lcEmail) << "Enqueuing new search:" << bodyText;
     enqueue(new SearchMessages(m_searchAction.data(), filter, bodyText, spec, limit, searchBody, sort));
 }
 
+void EmailAgent::searchRemoteMessages(const QMailAccountIdList &accountIds, const QMailMessageKey &filter,
+                                      const QString &bodyText, quint64 limit, bool searchBody,
+                                      const QMailMessageSortKey &sort)
+{
+    // Without network the queued action waits for a connection
+    if (accountIds.isEmpty() || !isOnline() || !QMailStore::instance()->isIpcConnectionEstablished()) {
+        searchMessages(filter, bodyText, QMailSearchAction::Remote, limit, searchBody, sort);
+        return;
+    }
+
+    cancelSearch();
+    m_searchCoordinator->search(accountIds, filter, bodyText, limit, searchBody, sort);
+}
+
+int EmailAgent::remoteSearchConcurrency() const
+{
+    return m_searchCoordinator->maximumConcurrent();
+}
+
+void EmailAgent::setRemoteSearchConcurrency(int count)
+{
+    m_searchCoordinator->setMaximumConcurrent(count);
+}
+
+int EmailAgent::remoteSearchCacheTimeToLive() const
+{
+    return m_searchCoordinator->cacheTimeToLive();
+}
+
+void EmailAgent::setRemoteSearchCacheTimeToLive(int seconds)
+{
+    m_searchCoordinator->setCacheTimeToLive(seconds);
+}
+
+bool EmailAgent::searchBodyIndex(const QMailMessageKey &filter, const QString &bodyText,
+                                 quint64 limit, const QMailMessageSortKey &sort)
+{
+    QMailMessageIdList candidates;
+    if (!m_bodySearchIndex->search(bodyText, &candidates)) {
+        return false;
+    }
+
+    // Same substring semantics as the search action, candidates of a text
+    // spanning several words are checked against the body in result order
+    QMailMessageIdList matchedIds;
+    if (!candidates.isEmpty() && BodySearchIndex::isExact(bodyText)) {
+        matchedIds = QMailStore::instance()->queryMessages(filter & QMailMessageKey::id(candidates), sort, limit);
+    } else if (!candidates.isEmpty()) {
+        const QMailMessageIdList ids = QMailStore::instance()->queryMessages(filter & QMailMessageKey::id(candidates), sort);
+        if (!limit && ids.count() > MaximumBodyVerifications) {
+            qCDebug(lcEmail) << "Too many body index candidates for" << bodyText << ids.count();
+            return false;
+        }
+        int verified = 0;
+        for (const QMailMessageId &id : ids) {
+            if (limit && quint64(matchedIds.count()) >= limit) {
+                break;
+            }
+            if (verified++ == MaximumBodyVerifications) {
+                qCDebug(lcEmail) << "Too many body index candidates for" << bodyText << ids.count();
+                return false;
+            }
+            if (BodySearchIndex::bodyContains(id, bodyText)) {
+                matchedIds.append(id);
+            }
+        }
+    }
+    qCDebug(lcEmail) << "Body index search for" << bodyText << "matched" << matchedIds.count() << "messages";
+
+    // Report like a finished search action would, after the caller has returned.
+    // A newer search or cancelling drops the result.
+    const quint64 generation = m_searchGeneration;
+    QTimer::singleShot(0, this, [=]() {
+        if (generation == m_searchGeneration) {
+            emit searchCompleted(bodyText, matchedIds, false, 0, EmailAgent::SearchDone);
+        }
+    });
+    return true;
+}
+
+HeaderSearchIndex *EmailAgent::headerSearchIndex() const
+{
+    return m_headerSearchIndex;
+}
+
+MessageFieldWriter *EmailAgent::messageFieldWriter() const
+{
+    return m_messageFieldWriter;
+}
+
+quint64 EmailAgent::searchGeneration() const
+{
+    return m_searchGeneration;
+}
+
 void EmailAgent::cancelSearch()
 {
-    // Starts from 1 since top of the queue will be removed separately
-    for (int i = 1; i < m_actionQueue.size();) {
-        if (m_actionQueue.at(i).data()->type() == EmailAction::Search) {
-            m_actionQueue.removeAt(i);
-            qCDebug(lcEmail) <<  "Search action removed from the queue";
-        } else {
-            ++i;
+    m_searchGeneration++;
+    m_searchCoordinator->cancel();
+
+    // The running action will be removed separately
+    for (QList<QSharedPointer<EmailAction> > &actionQueue : m_localLane->actionQueues) {
+        for (int i = 0; i < actionQueue.size();) {
+            if (actionQueue.at(i).data()->type() == EmailAction::Search
+                    && actionQueue.at(i) != m_localLane->currentAction) {
+                unqueueAction(actionQueue.at(i)->id());
+                actionQueue.removeAt(i);
+                qCDebug(lcEmail) <<  "Search action removed from the queue";
+            } else {
+                ++i;
+            }
         }
     }
     // cancel running action if is search
-    if (m_currentAction && (m_currentAction->type() == EmailAction::Search)) {
-        cancelCurrentAction();
+    if (m_localLane->currentAction && (m_localLane->currentAction->type() == EmailAction::Search)) {
+        cancelCurrentAction(m_localLane);
     }
 }
 
 void EmailAgent::cancelAll()
 {
-    m_actionQueue.clear();
-    if (m_currentAction) {
-        cancelCurrentAction();
+    // Accounts not started yet are left out of the round
+    m_syncAccountCount -= m_pendingSyncs.count();
+    m_pendingSyncs.clear();
+    emit accountsSyncProgressChanged();
+
+    // Changes waiting to be exported go out with the next synchronization
+    m_pendingExports.clear();
+    m_exportTimer->stop();
+
+    for (ActionLane *lane : lanes()) {
+        for (quint64 actionId : lane->queuedActions.keys()) {
+            m_actionLanes.remove(actionId);
+            if (m_journal) {
+                m_journal->remove(actionId);
+            }
+            m_statistics->actionFinished(actionId, ActionStatistics::Cancelled);
+        }
+        for (QList<QSharedPointer<EmailAction> > &actionQueue : lane->actionQueues) {
+            actionQueue.clear();
+        }
+        lane->queuedActions.clear();
+        lane->queuedKeys.clear();
+        lane->retries.clear();
+        if (lane->currentAction) {
+            cancelCurrentAction(lane);
+        }
+    }
+    scheduleRetryTimer();
+
+    // Lanes still busy finish their synchronization once the cancelled action is done
+    for (const QMailAccountId &accountId : m_runningSyncs.keys()) {
+        const ActionLane *accountLane = m_accountLanes.value(accountId);
+        if (!accountLane || !accountLane->currentAction) {
+            finishAccountSync(accountId);
+        }
     }
 }
 
@@ -314,55 +658,144 @@ bool EmailAgent::synchronizing() const
     return m_synchronizing;
 }
 
+bool EmailAgent::preemptBackgroundActions() const
+{
+    return m_preemptBackground;
+}
+
+void EmailAgent::setPreemptBackgroundActions(bool preempt)
+{
+    m_preemptBackground = preempt;
+}
+
+QVariantMap EmailAgent::actionStatistics() const
+{
+    return m_statistics->snapshot();
+}
+
+void EmailAgent::resetActionStatistics()
+{
+    m_statistics->reset();
+    emit actionStatisticsChanged();
+}
+
+int EmailAgent::actionStatisticsDumpInterval() const
+{
+    return m_statistics->dumpInterval();
+}
+
+void EmailAgent::setActionStatisticsDumpInterval(int seconds)
+{
+    m_statistics->setDumpInterval(seconds);
+}
+
 void EmailAgent::flagMessages(const QMailMessageIdList &ids, quint64 setMask, quint64 unsetMask)
 {
     Q_ASSERT(!ids.empty());
 
-    enqueue(new FlagMessages(m_storageAction.data(), ids, setMask, unsetMask));
+    // Each account's flags are stored on its own lane, not held up by the others
+    const QMap<QMailAccountId, QMailMessageIdList> accountMap = messageIdsByAccount(ids);
+    QMapIterator<QMailAccountId, QMailMessageIdList> iter(accountMap);
+    while (iter.hasNext()) {
+        iter.next();
+        enqueue(new FlagMessages(storageAction(iter.key()), iter.value(), setMask, unsetMask));
+    }
 }
 
 void EmailAgent::moveMessages(const QMailMessageIdList &ids, const QMailFolderId &destinationId)
 {
     Q_ASSERT(!ids.empty());
 
-    QMailMessageId id(ids[0]);
-    QMailAccountId accountId = accountForMessageId(id);
+    // Resolve source accounts before the messages change folder
+    QMailAccountIdList accountIdList = accountIdsForMessages(QMailMessageKey::id(ids));
+
+    QMailDisconnected::moveToFolder(ids, destinationId);
+
+    exportUpdates(accountIdList);
+}
+
+void EmailAgent::moveMessages(const QMailMessageKey &key, const QMailFolderId &destinationId)
+{
+    // The key may no longer match once the messages have moved, resolve it first
+    const QMailAccountIdList accountIdList = accountIdsForMessages(key);
+    const QMailMessageIdList ids = QMailStore::instance()->queryMessages(key);
+    if (ids.isEmpty()) {
+        return;
+    }
 
     QMailDisconnected::moveToFolder(ids, destinationId);
 
-    exportUpdates(QMailAccountIdList() << accountId);
+    exportUpdates(accountIdList);
 }
 
 void EmailAgent::sendMessage(const QMailMessageId &messageId)
 {
     if (messageId.isValid()) {
-        enqueue(new TransmitMessage(m_transmitAction.data(), messageId));
+        enqueue(new TransmitMessage(transmitAction(accountForMessageId(messageId)), messageId));
     }
 }
 
 void EmailAgent::sendMessages(const QMailAccountId &accountId)
 {
     if (accountId.isValid()) {
-        enqueue(new TransmitMessages(m_transmitAction.data(), accountId));
+        enqueue(new TransmitMessages(transmitAction(accountId), accountId));
     }
 }
 
 void EmailAgent::setMessagesReadState(const QMailMessageIdList &ids, bool state)
 {
     Q_ASSERT(!ids.empty());
-    QMailAccountIdList accountIdList;
+    setMessagesReadState(QMailMessageKey::id(ids), state);
+}
+
+void EmailAgent::setMessagesReadState(const QMailMessageKey &key, bool state)
+{
+    // Only touch messages which actually change, this also limits the export to their accounts
+    QMailMessageKey changingKey(key & QMailMessageKey::status(QMailMessage::Read,
+                                                              state ? QMailDataComparator::Excludes
+                                                                    : QMailDataComparator::Includes));
     // Messages can be from several accounts
-    for (const QMailMessageId &id : ids) {
-        QMailAccountId accountId = accountForMessageId(id);
-        if (!accountIdList.contains(accountId)) {
-            accountIdList.append(accountId);
-        }
+    QMailAccountIdList accountIdList = accountIdsForMessages(changingKey);
+    if (accountIdList.isEmpty()) {
+        return;
     }
 
-    QMailStore::instance()->updateMessagesMetaData(QMailMessageKey::id(ids), QMailMessage::Read, state);
+    QMailStore::instance()->updateMessagesMetaData(changingKey, QMailMessage::Read, state);
     exportUpdates(accountIdList);
 }
 
+QMailAccountIdList EmailAgent::accountIdsForMessages(const QMailMessageKey &key) const
+{
+    QMailAccountIdList accountIdList;
+    const QMailMessageMetaDataList metaDataList
+            = QMailStore::instance()->messagesMetaData(key, QMailMessageKey::ParentAccountId, QMailStore::ReturnDistinct);
+    for (const QMailMessageMetaData &metaData : metaDataList) {
+        if (metaData.parentAccountId().isValid()) {
+            accountIdList.append(metaData.parentAccountId());
+        }
+    }
+    return accountIdList;
+}
+
+QMap<QMailAccountId, QMailMessageIdList> EmailAgent::messageIdsByAccount(const QMailMessageIdList &ids) const
+{
+    if (ids.isEmpty()) {
+        return QMap<QMailAccountId, QMailMessageIdList>();
+    }
+    return messageIdsByAccount(QMailMessageKey::id(ids));
+}
+
+QMap<QMailAccountId, QMailMessageIdList> EmailAgent::messageIdsByAccount(const QMailMessageKey &key) const
+{
+    QMap<QMailAccountId, QMailMessageIdList> accountMap;
+    const QMailMessageMetaDataList metaDataList
+            = QMailStore::instance()->messagesMetaData(key, QMailMessageKey::Id | QMailMessageKey::ParentAccountId);
+    for (const QMailMessageMetaData &metaData : metaDataList) {
+        accountMap[metaData.parentAccountId()].append(metaData.id());
+    }
+    return accountMap;
+}
+
 void EmailAgent::setupAccountFlags()
 {
     if (!QMailStore::instance()->accountStatusMask("StandardFoldersRetrieved")) {
@@ -375,43 +808,69 @@ void EmailAgent::activityChanged(QMailServiceAction::Activity activity)
 {
     QMailServiceAction *action = static_cast<QMailServiceAction*>(sender());
     const QMailServiceAction::Status status(action->status());
+    ActionLane *lane = m_serviceActionLanes.value(action);
+    Q_ASSERT(lane);
 
     switch (activity) {
     case QMailServiceAction::Failed: {
-        if (m_cancellingSingleAction) {
+        if (lane->preempting || (lane->interrupted && !lane->cancellingSingleAction)) {
+            // Stays queued and runs again after the actions it gave way to or once back online
+            if (lane->preempting) {
+                qCDebug(lcEmail) << "Action preempted:" << lane->currentAction->description();
+                lane->currentAction->setPreemptCount(lane->currentAction->preemptCount() + 1);
+                m_statistics->actionPreempted(lane->currentAction->id());
+            } else {
+                qCDebug(lcEmail) << "Action interrupted by losing the network:" << lane->currentAction->description();
+                m_statistics->actionRetried(lane->currentAction->id());
+            }
+            lane->preempting = false;
+            lane->interrupted = false;
+            lane->cancellingSingleAction = false;
+            processNextAction(lane);
+            break;
+        }
+
+        if (lane->cancellingSingleAction) {
             qDebug(lcEmail) << Q_FUNC_INFO << "operation finished as failed while canceling. sender:" << sender();
         } else {
             // See qmailserviceaction.h for ErrorCodes
             qCWarning(lcEmail) << Q_FUNC_INFO << "operation failed error code:" << status.errorCode
                                << "error text:" << status.text << "account:" << status.accountId
                                << "connection status:" << action->connectivity() << "sender:" << sender();
+
+            if (scheduleRetry(lane, status.errorCode)) {
+                processNextAction(lane);
+                break;
+            }
         }
 
-        dequeue();
+        m_statistics->actionFinished(lane->currentAction->id(), lane->cancellingSingleAction
+                                     ? ActionStatistics::Cancelled : ActionStatistics::Failed);
+        emit actionStatisticsChanged();
+        dequeue(lane);
 
         bool sendFailed = false;
 
         // TODO: need to handle some more cancel cases without warnings?
-        if (m_currentAction->type() == EmailAction::Transmit) {
-            m_transmitting = false;
+        if (lane->currentAction->type() == EmailAction::Transmit) {
             sendFailed = true;
             emit sendCompleted(false);
             qCWarning(lcEmail) << "Error: Send failed";
 
-        } else if (m_currentAction->type() == EmailAction::Search) {
-            if (m_cancellingSingleAction) {
+        } else if (lane->currentAction->type() == EmailAction::Search) {
+            if (lane->cancellingSingleAction) {
                 qCDebug(lcEmail) << "Search canceled by the user";
-                emitSearchStatusChanges(m_currentAction, EmailAgent::SearchCanceled);
+                emitSearchStatusChanges(lane->currentAction, EmailAgent::SearchCanceled);
             } else {
                 qCWarning(lcEmail) << "Error: Search failed";
-                emitSearchStatusChanges(m_currentAction, EmailAgent::SearchFailed);
+                emitSearchStatusChanges(lane->currentAction, EmailAgent::SearchFailed);
             }
 
-        } else if (m_currentAction->type() == EmailAction::RetrieveMessagePart) {
-            RetrieveMessagePart* messagePartAction = static_cast<RetrieveMessagePart *>(m_currentAction.data());
+        } else if (lane->currentAction->type() == EmailAction::RetrieveMessagePart) {
+            RetrieveMessagePart* messagePartAction = static_cast<RetrieveMessagePart *>(lane->currentAction.data());
             if (messagePartAction->isAttachment()) {
                 // we assume cancelAttachmentDownload() does the status change signal
-                if (!m_cancellingSingleAction) {
+                if (!lane->cancellingSingleAction) {
                     updateAttachmentDownloadStatus(messagePartAction->partLocation(), Failed);
                     qCWarning(lcEmail) << "Attachment download failed for " << messagePartAction->partLocation();
                 }
@@ -420,14 +879,14 @@ void EmailAgent::activityChanged(QMailServiceAction::Activity activity)
                 qCWarning(lcEmail) << "Failed to download message part!!";
             }
 
-        } else if (m_currentAction->type() == EmailAction::RetrieveMessages) {
-            RetrieveMessages* retrieveMessagesAction = static_cast<RetrieveMessages *>(m_currentAction.data());
+        } else if (lane->currentAction->type() == EmailAction::RetrieveMessages) {
+            RetrieveMessages* retrieveMessagesAction = static_cast<RetrieveMessages *>(lane->currentAction.data());
             emit messagesDownloaded(retrieveMessagesAction->messageIds(), false);
             qCWarning(lcEmail) << "Failed to download messages";
 
-        } else if (m_currentAction->type() == EmailAction::CalendarInvitationResponse) {
-            if (m_currentAction->description().startsWith("eas-invitation-response")) {
-                EasInvitationResponse* responseAction = static_cast<EasInvitationResponse *>(m_currentAction.data());
+        } else if (lane->currentAction->type() == EmailAction::CalendarInvitationResponse) {
+            if (lane->currentAction->description().startsWith("eas-invitation-response")) {
+                EasInvitationResponse* responseAction = static_cast<EasInvitationResponse *>(lane->currentAction.data());
                 if (responseAction) {
                     emit calendarInvitationResponded(
                                 (CalendarInvitationResponse) responseAction->response(), false);
@@ -437,58 +896,62 @@ void EmailAgent::activityChanged(QMailServiceAction::Activity activity)
             }
         }
 
-        if (m_currentAction->type() == EmailAction::OnlineCreateFolder) {
+        if (lane->currentAction->type() == EmailAction::OnlineCreateFolder) {
             emit onlineFolderActionCompleted(ActionOnlineCreateFolder, false);
-        } else if (m_currentAction->type() == EmailAction::OnlineDeleteFolder) {
+        } else if (lane->currentAction->type() == EmailAction::OnlineDeleteFolder) {
             emit onlineFolderActionCompleted(ActionOnlineDeleteFolder, false);
-        } else if (m_currentAction->type() == EmailAction::OnlineRenameFolder) {
+        } else if (lane->currentAction->type() == EmailAction::OnlineRenameFolder) {
             emit onlineFolderActionCompleted(ActionOnlineRenameFolder, false);
-        } else if (m_currentAction->type() == EmailAction::OnlineMoveFolder) {
+        } else if (lane->currentAction->type() == EmailAction::OnlineMoveFolder) {
             emit onlineFolderActionCompleted(ActionOnlineMoveFolder, false);
-        } else if (!m_cancellingSingleAction && status.errorCode != QMailServiceAction::Status::ErrUnknownResponse) {
+        } else if (!lane->cancellingSingleAction && status.errorCode != QMailServiceAction::Status::ErrUnknownResponse) {
             reportError(status.accountId, status.errorCode, sendFailed);
         }
 
-        m_cancellingSingleAction = false;
-        processNextAction();
+        lane->cancellingSingleAction = false;
+        lane->interrupted = false;
+        processNextAction(lane);
         break;
     }
     case QMailServiceAction::Successful:
-        dequeue();
-
-        if (m_currentAction->type() == EmailAction::Transmit) {
-            qCDebug(lcEmail) << "Finished sending for accountId:" << m_currentAction->accountId();
-            m_transmitting = false;
+        lane->preempting = false;
+        lane->interrupted = false;
+        m_statistics->actionFinished(lane->currentAction->id(), ActionStatistics::Succeeded);
+        emit actionStatisticsChanged();
+        dequeue(lane);
+
+        if (lane->currentAction->type() == EmailAction::Transmit) {
+            qCDebug(lcEmail) << "Finished sending for accountId:" << lane->currentAction->accountId();
             emit sendCompleted(true);
 
-        } else if (m_currentAction->type() == EmailAction::Search) {
+        } else if (lane->currentAction->type() == EmailAction::Search) {
             qCDebug(lcEmail) << "Search done";
-            emitSearchStatusChanges(m_currentAction, EmailAgent::SearchDone);
+            emitSearchStatusChanges(lane->currentAction, EmailAgent::SearchDone);
 
-        } else if (m_currentAction->type() == EmailAction::StandardFolders) {
-            QMailAccount *account = new QMailAccount(m_currentAction->accountId());
+        } else if (lane->currentAction->type() == EmailAction::StandardFolders) {
+            QMailAccount *account = new QMailAccount(lane->currentAction->accountId());
             account->setStatus(QMailAccount::statusMask("StandardFoldersRetrieved"), true);
             QMailStore::instance()->updateAccount(account);
-            emit standardFoldersCreated(m_currentAction->accountId());
+            emit standardFoldersCreated(lane->currentAction->accountId());
 
-        } else if (m_currentAction->type() == EmailAction::RetrieveFolderList) {
-            emit folderRetrievalCompleted(m_currentAction->accountId());
+        } else if (lane->currentAction->type() == EmailAction::RetrieveFolderList) {
+            emit folderRetrievalCompleted(lane->currentAction->accountId());
 
-        } else if (m_currentAction->type() == EmailAction::RetrieveMessagePart) {
-            RetrieveMessagePart* messagePartAction = static_cast<RetrieveMessagePart *>(m_currentAction.data());
+        } else if (lane->currentAction->type() == EmailAction::RetrieveMessagePart) {
+            RetrieveMessagePart* messagePartAction = static_cast<RetrieveMessagePart *>(lane->currentAction.data());
             if (messagePartAction->isAttachment()) {
                 saveAttachmentToDownloads(messagePartAction->messageId(), messagePartAction->partLocation());
             } else {
                 emit messagePartDownloaded(messagePartAction->messageId(), messagePartAction->partLocation(), true);
             }
 
-        } else if (m_currentAction->type() == EmailAction::RetrieveMessages) {
-            RetrieveMessages* retrieveMessagesAction = static_cast<RetrieveMessages *>(m_currentAction.data());
+        } else if (lane->currentAction->type() == EmailAction::RetrieveMessages) {
+            RetrieveMessages* retrieveMessagesAction = static_cast<RetrieveMessages *>(lane->currentAction.data());
             emit messagesDownloaded(retrieveMessagesAction->messageIds(), true);
 
-        } else if (m_currentAction->type() == EmailAction::CalendarInvitationResponse) {
-            if (m_currentAction->description().startsWith("eas-invitation-response")) {
-                EasInvitationResponse* responseAction = static_cast<EasInvitationResponse *>(m_currentAction.data());
+        } else if (lane->currentAction->type() == EmailAction::CalendarInvitationResponse) {
+            if (lane->currentAction->description().startsWith("eas-invitation-response")) {
+                EasInvitationResponse* responseAction = static_cast<EasInvitationResponse *>(lane->currentAction.data());
                 if (responseAction) {
                     emit calendarInvitationResponded(
                                 (CalendarInvitationResponse) responseAction->response(), true);
@@ -497,17 +960,17 @@ void EmailAgent::activityChanged(QMailServiceAction::Activity activity)
                 emit calendarInvitationResponded(InvitationResponseUnspecified, true);
             }
 
-        } else if (m_currentAction->type() == EmailAction::OnlineCreateFolder) {
+        } else if (lane->currentAction->type() == EmailAction::OnlineCreateFolder) {
             emit onlineFolderActionCompleted(ActionOnlineCreateFolder, true);
-        } else if (m_currentAction->type() == EmailAction::OnlineDeleteFolder) {
+        } else if (lane->currentAction->type() == EmailAction::OnlineDeleteFolder) {
             emit onlineFolderActionCompleted(ActionOnlineDeleteFolder, true);
-        } else if (m_currentAction->type() == EmailAction::OnlineRenameFolder) {
+        } else if (lane->currentAction->type() == EmailAction::OnlineRenameFolder) {
             emit onlineFolderActionCompleted(ActionOnlineRenameFolder, true);
-        } else if (m_currentAction->type() == EmailAction::OnlineMoveFolder) {
+        } else if (lane->currentAction->type() == EmailAction::OnlineMoveFolder) {
             emit onlineFolderActionCompleted(ActionOnlineMoveFolder, true);
         }
 
-        processNextAction();
+        processNextAction(lane);
         break;
 
     default:
@@ -521,29 +984,55 @@ void EmailAgent::onIpcConnectionEstablished()
 {
     if (m_waitForIpc) {
         m_waitForIpc = false;
-        if (m_currentAction.isNull())
-            m_currentAction = getNext();
+        for (ActionLane *lane : lanes()) {
+            if (lane->currentAction.isNull())
+                lane->currentAction = getNext(lane);
 
-        if (m_currentAction.isNull()) {
+            if (!lane->currentAction.isNull()) {
+                executeCurrent(lane);
+            }
+        }
+        if (!m_synchronizing) {
             qCDebug(lcEmail) << "Ipc connection established, but no action in the queue.";
-        } else {
-            executeCurrent();
         }
         emit ipcConnectionEstablished();
     }
 }
 
+void EmailAgent::onSearchMessageIdsMatched(const QMailMessageIdList &ids)
+{
+    // A cancelled search action can still report matches until it has stopped
+    if (m_searchActionGeneration == m_searchGeneration) {
+        emit searchMessageIdsMatched(ids);
+    }
+}
+
+void EmailAgent::onRemoteSearchCompleted(const QString &search, const QMailMessageIdList &matchedIds,
+                                         int remainingMessagesOnRemote, bool success)
+{
+    qCDebug(lcEmail) << "Remote search completed for" << search;
+    emit searchCompleted(search, matchedIds, true, remainingMessagesOnRemote,
+                         success ? EmailAgent::SearchDone : EmailAgent::SearchFailed);
+}
+
 void EmailAgent::onOnlineStateChanged(bool isOnline)
 {
     qCDebug(lcEmail) << Q_FUNC_INFO << "Online State changed, device is now connected?" << isOnline;
     if (isOnline) {
-        if (m_currentAction.isNull())
-            m_currentAction = getNext();
+        for (ActionLane *lane : lanes()) {
+            // Failures on the connection are retried right away, keeping their attempt count
+            for (ActionLane::Retry &retry : lane->retries) {
+                retry.due = 0;
+            }
+            if (lane->currentAction.isNull())
+                lane->currentAction = getNext(lane);
 
-        if (m_currentAction.isNull()) {
+            if (!lane->currentAction.isNull()) {
+                executeCurrent(lane);
+            }
+        }
+        if (!m_synchronizing) {
             qCDebug(lcEmail) << "Network connection established, but no action in the queue.";
-        } else {
-            executeCurrent();
         }
     } else {
         if (m_synchronizing) {
@@ -555,9 +1044,13 @@ void EmailAgent::onOnlineStateChanged(bool isOnline)
             m_accountSynchronizing = 0;
             emit currentSynchronizingAccountIdChanged();
         }
-        if (!m_currentAction.isNull() && m_currentAction->needsNetworkConnection() && m_currentAction->serviceAction()->isRunning()) {
-            // TODO: should this be responsibility of the backend? cancelOperation is kind of hinted being a user initiated action.
-            m_currentAction->serviceAction()->cancelOperation();
+        for (ActionLane *lane : lanes()) {
+            const QSharedPointer<EmailAction> &currentAction = lane->currentAction;
+            if (!currentAction.isNull() && currentAction->needsNetworkConnection() && currentAction->serviceAction()->isRunning()) {
+                // TODO: should this be responsibility of the backend? cancelOperation is kind of hinted being a user initiated action.
+                lane->interrupted = true;
+                currentAction->serviceAction()->cancelOperation();
+            }
         }
     }
 }
@@ -565,9 +1058,24 @@ void EmailAgent::onOnlineStateChanged(bool isOnline)
 // Note: values from here are not byte sizes, it's something like "indicative size" which qmf defines internally as size in kilobytes
 void EmailAgent::progressChanged(uint value, uint total)
 {
+    ActionLane *lane = m_serviceActionLanes.value(sender());
+    if (!lane || lane->currentAction.isNull()) {
+        return;
+    }
+
+    QHash<QMailAccountId, double>::iterator sync = m_runningSyncs.find(lane->accountId);
+    if (sync != m_runningSyncs.end() && total > 0) {
+        // Each action of the sync reports from zero, keep the account progress from going back
+        const double progress = qMin(1.0, double(value) / total);
+        if (progress > sync.value()) {
+            sync.value() = progress;
+            emit accountsSyncProgressChanged();
+        }
+    }
+
     // Attachment download, do not spam the UI check should be done here
-    if (value < total && m_currentAction->type() == EmailAction::RetrieveMessagePart) {
-        RetrieveMessagePart* messagePartAction = static_cast<RetrieveMessagePart *>(m_currentAction.data());
+    if (value < total && lane->currentAction->type() == EmailAction::RetrieveMessagePart) {
+        RetrieveMessagePart* messagePartAction = static_cast<RetrieveMessagePart *>(lane->currentAction.data());
         if (messagePartAction->isAttachment()) {
             QString location = messagePartAction->partLocation();
             if (m_attachmentDownloadQueue.contains(location)) {
@@ -584,6 +1092,46 @@ void EmailAgent::progressChanged(uint value, uint total)
     }
 }
 
+void EmailAgent::onApplicationStateChanged(Qt::ApplicationState state)
+{
+    if (state != Qt::ApplicationActive && !m_pendingExports.isEmpty()) {
+        flushPendingExports();
+    }
+}
+
+void EmailAgent::onAccountsRemoved(const QMailAccountIdList &ids)
+{
+    for (int i = 0; i < m_pendingSyncs.count();) {
+        if (ids.contains(m_pendingSyncs.at(i).accountId)) {
+            m_pendingSyncs.removeAt(i);
+            m_syncedAccountCount++;
+        } else {
+            ++i;
+        }
+    }
+
+    for (const QMailAccountId &accountId : ids) {
+        m_pendingExports.remove(accountId);
+        if (m_runningSyncs.contains(accountId)) {
+            finishAccountSync(accountId);
+        }
+        ActionLane *lane = m_accountLanes.value(accountId);
+        // Busy lanes are kept, their remaining actions fail on their own
+        if (!lane || !lane->currentAction.isNull() || !lane->queuedActions.isEmpty()) {
+            continue;
+        }
+
+        m_accountLanes.remove(accountId);
+        const QList<QMailServiceAction *> serviceActions = QList<QMailServiceAction *>()
+                << lane->retrievalAction << lane->storageAction << lane->transmitAction << lane->protocolAction;
+        for (QMailServiceAction *serviceAction : serviceActions) {
+            m_serviceActionLanes.remove(serviceAction);
+            serviceAction->deleteLater();
+        }
+        delete lane;
+    }
+}
+
 // ############# Invokable API ########################
 
 // Sync all accounts (both ways)
@@ -597,14 +1145,128 @@ void EmailAgent::accountsSync(bool syncOnlyInbox, uint minimum)
     if (m_enabledAccounts.isEmpty()) {
         qCDebug(lcEmail) << Q_FUNC_INFO << "No enabled accounts, nothing to do.";
     } else {
+        if (m_pendingSyncs.isEmpty() && m_runningSyncs.isEmpty()) {
+            m_syncAccountCount = 0;
+            m_syncedAccountCount = 0;
+        }
+
+        // Accounts already in the round are not added again
         for (const QMailAccountId &accountId : m_enabledAccounts) {
-            if (syncOnlyInbox) {
-                synchronizeInbox(accountId.toULongLong(), minimum);
-            } else {
-                synchronize(accountId.toULongLong(), minimum);
+            if (m_runningSyncs.contains(accountId)) {
+                continue;
+            }
+            bool pending = false;
+            for (PendingSync &pendingSync : m_pendingSyncs) {
+                if (pendingSync.accountId == accountId) {
+                    pendingSync.inboxOnly = pendingSync.inboxOnly && syncOnlyInbox;
+                    pendingSync.minimum = qMax(pendingSync.minimum, minimum);
+                    pending = true;
+                    break;
+                }
+            }
+            if (!pending) {
+                PendingSync pendingSync;
+                pendingSync.accountId = accountId;
+                pendingSync.inboxOnly = syncOnlyInbox;
+                pendingSync.minimum = minimum;
+                m_pendingSyncs.append(pendingSync);
+                m_syncAccountCount++;
             }
         }
+
+        sortPendingSyncs();
+        emit accountsSyncProgressChanged();
+        dispatchAccountSyncs();
+    }
+}
+
+void EmailAgent::sortPendingSyncs()
+{
+    struct SyncOrder {
+        qint64 age;
+        int unread;
+    };
+
+    // Accounts synchronized longest ago go first, the ones never synchronized before all others
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QHash<QMailAccountId, SyncOrder> order;
+    for (const PendingSync &pendingSync : m_pendingSyncs) {
+        const QMailAccount account = QMailStore::instance()->account(pendingSync.accountId);
+        const QDateTime lastSynchronized = account.lastSynchronized().toUTC();
+        SyncOrder syncOrder;
+        syncOrder.age = lastSynchronized.isValid() ? lastSynchronized.secsTo(now) / SyncAgeGranularity
+                                                   : std::numeric_limits<qint64>::max();
+        syncOrder.unread = QMailStore::instance()->countMessages(
+                    QMailMessageKey::parentAccountId(pendingSync.accountId)
+                    & QMailMessageKey::status(QMailMessage::Read, QMailDataComparator::Excludes));
+        order.insert(pendingSync.accountId, syncOrder);
     }
+
+    std::stable_sort(m_pendingSyncs.begin(), m_pendingSyncs.end(),
+                     [&order](const PendingSync &first, const PendingSync &second) {
+        const SyncOrder &firstOrder = order[first.accountId];
+        const SyncOrder &secondOrder = order[second.accountId];
+        if (firstOrder.age != secondOrder.age) {
+            return firstOrder.age > secondOrder.age;
+        }
+        return firstOrder.unread > secondOrder.unread;
+    });
+}
+
+void EmailAgent::dispatchAccountSyncs()
+{
+    while (!m_pendingSyncs.isEmpty() && m_runningSyncs.count() < m_accountsSyncConcurrency) {
+        const PendingSync pendingSync = m_pendingSyncs.takeFirst();
+        m_runningSyncs.insert(pendingSync.accountId, 0.0);
+        qCDebug(lcEmail) << "Synchronizing account" << pendingSync.accountId << "with"
+                         << m_pendingSyncs.count() << "accounts waiting";
+
+        if (pendingSync.inboxOnly) {
+            synchronizeInbox(pendingSync.accountId.toULongLong(), pendingSync.minimum);
+        } else {
+            synchronize(pendingSync.accountId.toULongLong(), pendingSync.minimum);
+        }
+
+        // Nothing to wait for if no action got queued
+        const ActionLane *accountLane = m_accountLanes.value(pendingSync.accountId);
+        if (m_runningSyncs.contains(pendingSync.accountId) && (!accountLane || accountLane->queuedActions.isEmpty())) {
+            m_runningSyncs.remove(pendingSync.accountId);
+            m_syncedAccountCount++;
+            emit accountsSyncProgressChanged();
+        }
+    }
+}
+
+void EmailAgent::finishAccountSync(const QMailAccountId &accountId)
+{
+    m_runningSyncs.remove(accountId);
+    m_syncedAccountCount++;
+    emit accountsSyncProgressChanged();
+    dispatchAccountSyncs();
+}
+
+int EmailAgent::accountsSyncConcurrency() const
+{
+    return m_accountsSyncConcurrency;
+}
+
+void EmailAgent::setAccountsSyncConcurrency(int count)
+{
+    m_accountsSyncConcurrency = qMax(1, count);
+    dispatchAccountSyncs();
+}
+
+double EmailAgent::accountsSyncProgress() const
+{
+    if (m_syncAccountCount <= 0) {
+        return 1.0;
+    }
+
+    double done = m_syncedAccountCount;
+    for (double progress : m_runningSyncs) {
+        done += progress;
+    }
+    return qMin(1.0, done / m_syncAccountCount);
 }
 
 // Sync all accounts (both ways), just the inboxes
@@ -632,7 +1294,7 @@ void EmailAgent::createFolder(const QString &name, int mailAccountId, int parent
 
         QMailFolderId parentId(parentFolderId);
 
-        enqueue(new OnlineCreateFolder(m_storageAction.data(), name, accountId, parentId));
+        enqueue(new OnlineCreateFolder(storageAction(accountId), name, accountId, parentId));
     }
 }
 
@@ -641,7 +1303,7 @@ void EmailAgent::deleteFolder(int folderId)
     QMailFolderId id(folderId);
     Q_ASSERT(id.isValid());
 
-    enqueue(new OnlineDeleteFolder(m_storageAction.data(), id));
+    enqueue(new OnlineDeleteFolder(storageAction(accountForFolderId(id)), id));
 }
 
 void EmailAgent::deleteMessage(int messageId)
@@ -674,39 +1336,41 @@ void EmailAgent::deleteMessages(const QMailMessageIdList &ids)
 {
     Q_ASSERT(!ids.isEmpty());
 
-    if (m_transmitting) {
+    deleteMessages(QMailMessageKey::id(ids));
+}
+
+void EmailAgent::deleteMessages(const QMailMessageKey &key)
+{
+    if (isTransmitting()) {
         // Do not delete messages from the outbox folder while we're sending
         QMailMessageKey outboxFilter(QMailMessageKey::status(QMailMessage::Outbox));
-        if (QMailStore::instance()->countMessages(QMailMessageKey::id(ids) & outboxFilter)) {
+        if (QMailStore::instance()->countMessages(key & outboxFilter)) {
             //TODO: emit proper error
             return;
         }
     }
 
-    bool exptUpdates;
+    bool exptUpdates = false;
 
-    QMap<QMailAccountId, QMailMessageIdList> accountMap;
-    // Messages can be from several accounts
-    for (const QMailMessageId &id : ids) {
-        QMailAccountId accountId = accountForMessageId(id);
-        if (accountMap.contains(accountId)) {
-            QMailMessageIdList idList = accountMap.value(accountId);
-            idList.append(id);
-            accountMap.insert(accountId, idList);
-        } else {
-            accountMap.insert(accountId, QMailMessageIdList() << id);
-        }
+    // Messages can be from several accounts, the ids are resolved once here as
+    // the key may stop matching while the messages are moved or removed
+    const QMap<QMailAccountId, QMailMessageIdList> accountMap = messageIdsByAccount(key);
+    QMailMessageIdList ids;
+    for (const QMailMessageIdList &accountIds : accountMap) {
+        ids += accountIds;
+    }
+    if (ids.isEmpty()) {
+        return;
     }
 
     // If any of these messages are not yet trash, then we're only moved to trash
-    QMailMessageKey idFilter(QMailMessageKey::id(ids));
     QMailMessageKey notTrashFilter(QMailMessageKey::status(QMailMessage::Trash, QMailDataComparator::Excludes));
 
-    const bool deleting(QMailStore::instance()->countMessages(idFilter & notTrashFilter) == 0);
+    const bool deleting(QMailStore::instance()->countMessages(key & notTrashFilter) == 0);
 
     if (deleting) {
         // delete LocalOnly messages clientside first
-        QMailMessageKey localOnlyKey(QMailMessageKey::id(ids) & QMailMessageKey::status(QMailMessage::LocalOnly));
+        QMailMessageKey localOnlyKey(key & QMailMessageKey::status(QMailMessage::LocalOnly));
         QMailMessageIdList localOnlyIds(QMailStore::instance()->queryMessages(localOnlyKey));
         QMailMessageIdList idsToRemove(ids);
         if (!localOnlyIds.isEmpty()) {
@@ -714,8 +1378,22 @@ void EmailAgent::deleteMessages(const QMailMessageIdList &ids)
             idsToRemove = (ids.toSet().subtract(localOnlyIds.toSet())).toList();
         }
         if (!idsToRemove.isEmpty()) {
+            // Queued per account, the export of each account comes after its deletion
+            const QSet<QMailMessageId> removing(idsToRemove.toSet());
             m_enqueing = true;
-            enqueue(new DeleteMessages(m_storageAction.data(), idsToRemove));
+            QMapIterator<QMailAccountId, QMailMessageIdList> iter(accountMap);
+            while (iter.hasNext()) {
+                iter.next();
+                QMailMessageIdList accountIds;
+                for (const QMailMessageId &id : iter.value()) {
+                    if (removing.contains(id)) {
+                        accountIds.append(id);
+                    }
+                }
+                if (!accountIds.isEmpty()) {
+                    enqueue(new DeleteMessages(storageAction(iter.key()), accountIds));
+                }
+            }
             exptUpdates = true;
         }
     } else {
@@ -730,8 +1408,8 @@ void EmailAgent::deleteMessages(const QMailMessageIdList &ids)
                 trashFolderId = QMailFolder::LocalStorageFolderId;
             }
             m_enqueing = true;
-            enqueue(new MoveToFolder(m_storageAction.data(), iter.value(), trashFolderId));
-            enqueue(new FlagMessages(m_storageAction.data(), iter.value(), QMailMessage::Trash, 0));
+            enqueue(new MoveToFolder(storageAction(iter.key()), iter.value(), trashFolderId));
+            enqueue(new FlagMessages(storageAction(iter.key()), iter.value(), QMailMessage::Trash, 0));
             if (!iter.hasNext()) {
                 m_enqueing = false;
             }
@@ -749,18 +1427,23 @@ void EmailAgent::deleteMessages(const QMailMessageIdList &ids)
 
 void EmailAgent::expungeMessages(const QMailMessageIdList &ids)
 {
-    m_enqueing = true;
-    enqueue(new DeleteMessages(m_storageAction.data(), ids));
+    if (ids.isEmpty()) {
+        return;
+    }
 
-    QMailAccountIdList accountList;
     // Messages can be from several accounts
-    for (const QMailMessageId &id : ids) {
-        QMailAccountId accountId = accountForMessageId(id);
-        if (!accountList.contains(accountId)) {
-            accountList.append(accountId);
-        }
+    const QMap<QMailAccountId, QMailMessageIdList> accountMap = messageIdsByAccount(ids);
+
+    // Queued per account, the export of each account comes after its deletion
+    m_enqueing = true;
+    QMapIterator<QMailAccountId, QMailMessageIdList> iter(accountMap);
+    while (iter.hasNext()) {
+        iter.next();
+        enqueue(new DeleteMessages(storageAction(iter.key()), iter.value()));
     }
 
+    QMailAccountIdList accountList = accountMap.keys();
+
     // Export updates for all accounts that we deleted messages from
     exportUpdates(accountList);
 }
@@ -782,7 +1465,7 @@ bool EmailAgent::downloadAttachment(int messageId, const QString &attachmentLoca
             return saveAttachmentToDownloads(mailMessageId, attachmentLocation);
         } else {
             qCDebug(lcEmail) << "Start Download for:" << attachmentLocation;
-            enqueue(new RetrieveMessagePart(m_retrievalAction.data(), location, true));
+            enqueue(new RetrieveMessagePart(retrievalAction(message.parentAccountId()), location, true));
         }
     } else {
         qCDebug(lcEmail) << "ERROR: Attachment location not found:" << attachmentLocation;
@@ -815,7 +1498,8 @@ void EmailAgent::getMoreMessages(int folderId, uint minimum)
         QMailMessageKey countKey(QMailMessageKey::parentFolderId(foldId));
         countKey &= ~QMailMessageKey::status(QMailMessage::Temporary);
         minimum += QMailStore::instance()->countMessages(countKey);
-        enqueue(new RetrieveMessageList(m_retrievalAction.data(), folder.parentAccountId(), foldId, minimum));
+        enqueue(new RetrieveMessageList(retrievalAction(folder.parentAccountId()), folder.parentAccountId(), foldId, minimum),
+                EmailAction::UserInitiatedPriority);
     }
 }
 
@@ -890,18 +1574,12 @@ bool EmailAgent::isMessageValid(int messageId)
 
 void EmailAgent::markMessageAsRead(int messageId)
 {
-    QMailMessageId id(messageId);
-    quint64 status(QMailMessage::Read);
-    QMailStore::instance()->updateMessagesMetaData(QMailMessageKey::id(id), status, true);
-    exportUpdates(QMailAccountIdList() << accountForMessageId(id));
+    setMessagesReadState(QMailMessageIdList() << QMailMessageId(messageId), true);
 }
 
 void EmailAgent::markMessageAsUnread(int messageId)
 {
-    QMailMessageId id(messageId);
-    quint64 status(QMailMessage::Read);
-    QMailStore::instance()->updateMessagesMetaData(QMailMessageKey::id(id), status, false);
-    exportUpdates(QMailAccountIdList() << accountForMessageId(id));
+    setMessagesReadState(QMailMessageIdList() << QMailMessageId(messageId), false);
 }
 
 void EmailAgent::moveMessage(int messageId, int destinationId)
@@ -920,7 +1598,7 @@ void EmailAgent::moveFolder(int folderId, int parentFolderId)
         qCDebug(lcEmail) << "Error: Invalid folderId specified for moveFolder: " << folderId;
     } else {
         QMailFolderId parentId(parentFolderId);
-        enqueue(new OnlineMoveFolder(m_storageAction.data(), id, parentId));
+        enqueue(new OnlineMoveFolder(storageAction(accountForFolderId(id)), id, parentId));
     }
 }
 
@@ -932,7 +1610,7 @@ void EmailAgent::renameFolder(int folderId, const QString &name)
         QMailFolderId id(folderId);
         Q_ASSERT(id.isValid());
 
-        enqueue(new OnlineRenameFolder(m_storageAction.data(),id, name));
+        enqueue(new OnlineRenameFolder(storageAction(accountForFolderId(id)), id, name));
     }
 }
 
@@ -942,7 +1620,7 @@ void EmailAgent::retrieveFolderList(int accountId, int folderId, bool descending
     QMailFolderId foldId(folderId);
 
     if (acctId.isValid()) {
-        enqueue(new RetrieveFolderList(m_retrievalAction.data(), acctId, foldId, descending));
+        enqueue(new RetrieveFolderList(retrievalAction(acctId), acctId, foldId, descending));
     }
 }
 
@@ -952,14 +1630,16 @@ void EmailAgent::retrieveMessageList(int accountId, int folderId, uint minimum)
     QMailFolderId foldId(folderId);
 
     if (acctId.isValid()) {
-        enqueue(new RetrieveMessageList(m_retrievalAction.data(), acctId, foldId, minimum));
+        enqueue(new RetrieveMessageList(retrievalAction(acctId), acctId, foldId, minimum),
+                EmailAction::UserInitiatedPriority);
     }
 }
 
 void EmailAgent::retrieveMessageRange(int messageId, uint minimum)
 {
     QMailMessageId id(messageId);
-    enqueue(new RetrieveMessageRange(m_retrievalAction.data(), id, minimum));
+    enqueue(new RetrieveMessageRange(retrievalAction(accountForMessageId(id)), id, minimum),
+            EmailAction::InteractivePriority);
 }
 
 void EmailAgent::processSendingQueue(int accountId)
@@ -978,15 +1658,16 @@ void EmailAgent::synchronize(int accountId, uint minimum)
         return;
     }
 
+    dropPendingExport(acctId);
     bool messagesToSend = hasMessagesInOutbox(acctId);
     if (messagesToSend) {
         m_enqueing = true;
     }
-    enqueue(new Synchronize(m_retrievalAction.data(), acctId, minimum));
+    enqueue(new Synchronize(retrievalAction(acctId), acctId, minimum));
     if (messagesToSend) {
         m_enqueing = false;
         // Send any message waiting in the outbox
-        enqueue(new TransmitMessages(m_transmitAction.data(), acctId));
+        enqueue(new TransmitMessages(transmitAction(acctId), acctId));
     }
 }
 
@@ -1002,17 +1683,18 @@ void EmailAgent::synchronizeInbox(int accountId, uint minimum)
     QMailFolderId foldId = account.standardFolder(QMailFolder::InboxFolder);
     if (foldId.isValid()) {
         bool messagesToSend = hasMessagesInOutbox(acctId);
+        dropPendingExport(acctId);
         m_enqueing = true;
-        enqueue(new ExportUpdates(m_retrievalAction.data(), acctId));
-        enqueue(new RetrieveFolderList(m_retrievalAction.data(), acctId, QMailFolderId(), true));
+        enqueue(new ExportUpdates(retrievalAction(acctId), acctId));
+        enqueue(new RetrieveFolderList(retrievalAction(acctId), acctId, QMailFolderId(), true));
         if (!messagesToSend) {
             m_enqueing = false;
         }
-        enqueue(new RetrieveMessageList(m_retrievalAction.data(), acctId, foldId, minimum));
+        enqueue(new RetrieveMessageList(retrievalAction(acctId), acctId, foldId, minimum));
         if (messagesToSend) {
             m_enqueing = false;
             // send any message in the outbox
-            enqueue(new TransmitMessages(m_transmitAction.data(), acctId));
+            enqueue(new TransmitMessages(transmitAction(acctId), acctId));
         }
 
     } else { //Account was never synced, retrieve list of folders and come back here.
@@ -1029,9 +1711,9 @@ void EmailAgent::synchronizeInbox(int accountId, uint minimum)
                     }
                 });
         m_enqueing = true;
-        enqueue(new RetrieveFolderList(m_retrievalAction.data(), acctId, QMailFolderId(), true));
+        enqueue(new RetrieveFolderList(retrievalAction(acctId), acctId, QMailFolderId(), true));
         m_enqueing = false;
-        enqueue(new CreateStandardFolders(m_retrievalAction.data(), acctId));
+        enqueue(new CreateStandardFolders(retrievalAction(acctId), acctId));
     }
 }
 
@@ -1162,7 +1844,7 @@ bool EmailAgent::easCalendarInvitationResponse(const QMailMessage &message,
     data.insert("response", responseString);
     data.insert("replyMessageId", responseMsg.id().toULongLong());
 
-    enqueue(new EasInvitationResponse(m_protocolAction.data(), message.parentAccountId(),
+    enqueue(new EasInvitationResponse(protocolAction(message.parentAccountId()), message.parentAccountId(),
                                       response, data));
     exportUpdates(QMailAccountIdList() << message.parentAccountId());
     return true;
@@ -1170,40 +1852,286 @@ bool EmailAgent::easCalendarInvitationResponse(const QMailMessage &message,
 
 // ############## Private API #########################
 
-bool EmailAgent::actionInQueue(QSharedPointer<EmailAction> action) const
+EmailAgent::ActionLane *EmailAgent::createLane(const QMailAccountId &accountId)
+{
+    ActionLane *lane = new ActionLane;
+    lane->accountId = accountId;
+    lane->actionQueues.resize(EmailAction::InteractivePriority + 1);
+    lane->retrievalAction = new QMailRetrievalAction(this);
+    lane->storageAction = new QMailStorageAction(this);
+    lane->transmitAction = new QMailTransmitAction(this);
+    lane->protocolAction = new QMailProtocolAction(this);
+
+    const QList<QMailServiceAction *> serviceActions = QList<QMailServiceAction *>()
+            << lane->retrievalAction << lane->storageAction << lane->transmitAction << lane->protocolAction;
+    for (QMailServiceAction *serviceAction : serviceActions) {
+        m_serviceActionLanes.insert(serviceAction, lane);
+        connect(serviceAction, SIGNAL(activityChanged(QMailServiceAction::Activity)),
+                this, SLOT(activityChanged(QMailServiceAction::Activity)));
+    }
+
+    connect(lane->retrievalAction, SIGNAL(progressChanged(uint, uint)),
+            this, SLOT(progressChanged(uint,uint)));
+    connect(lane->transmitAction, SIGNAL(progressChanged(uint, uint)),
+            this, SLOT(progressChanged(uint,uint)));
+
+    return lane;
+}
+
+EmailAgent::ActionLane *EmailAgent::lane(const QMailAccountId &accountId)
+{
+    if (!accountId.isValid()) {
+        return m_localLane;
+    }
+
+    ActionLane *&accountLane = m_accountLanes[accountId];
+    if (!accountLane) {
+        accountLane = createLane(accountId);
+    }
+    return accountLane;
+}
+
+QList<EmailAgent::ActionLane *> EmailAgent::lanes() const
+{
+    return QList<ActionLane *>() << m_localLane << m_accountLanes.values();
+}
+
+QMailRetrievalAction *EmailAgent::retrievalAction(const QMailAccountId &accountId)
+{
+    return lane(accountId)->retrievalAction;
+}
+
+QMailStorageAction *EmailAgent::storageAction(const QMailAccountId &accountId)
+{
+    return lane(accountId)->storageAction;
+}
+
+QMailTransmitAction *EmailAgent::transmitAction(const QMailAccountId &accountId)
+{
+    return lane(accountId)->transmitAction;
+}
+
+QMailProtocolAction *EmailAgent::protocolAction(const QMailAccountId &accountId)
+{
+    return lane(accountId)->protocolAction;
+}
+
+bool EmailAgent::isTransmitting() const
+{
+    for (const ActionLane *lane : lanes()) {
+        if (!lane->currentAction.isNull() && lane->currentAction->type() == EmailAction::Transmit
+                && lane->currentAction->serviceAction()->isRunning()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool EmailAgent::actionInQueue(ActionLane *lane, QSharedPointer<EmailAction> action) const
 {
     // check current first, there's chances that
     // user taps same action several times.
-    if (!m_currentAction.isNull()
-        && *(m_currentAction.data()) == *(action.data())) {
+    if (!lane->currentAction.isNull()
+        && *(lane->currentAction.data()) == *(action.data())) {
         return true;
     } else {
-        return actionInQueueId(action) != quint64(0);
+        return actionInQueueId(lane, action) != quint64(0);
+    }
+}
+
+quint64 EmailAgent::actionInQueueId(ActionLane *lane, QSharedPointer<EmailAction> action) const
+{
+    if (!action->key().isValid()) {
+        return quint64(0);
+    }
+    return lane->queuedKeys.value(action->key(), quint64(0));
+}
+
+void EmailAgent::dequeue(ActionLane *lane)
+{
+    if (lane->currentAction.isNull()) {
+        return;
+    }
+
+    // The running action is normally the first one of its priority
+    QList<QSharedPointer<EmailAction> > &actionQueue = lane->actionQueues[lane->currentAction->priority()];
+    if (!actionQueue.isEmpty() && actionQueue.first() == lane->currentAction) {
+        actionQueue.removeFirst();
+    } else {
+        actionQueue.removeOne(lane->currentAction);
     }
+    unqueueAction(lane->currentAction->id());
 }
 
-quint64 EmailAgent::actionInQueueId(QSharedPointer<EmailAction> action) const
+void EmailAgent::queueAction(ActionLane *lane, QSharedPointer<EmailAction> action)
 {
-    for (const QSharedPointer<EmailAction> &a : m_actionQueue) {
-        if (*(a.data()) == *(action.data())) {
-            return a.data()->id();
+    lane->actionQueues[action->priority()].append(action);
+    lane->queuedActions.insert(action->id(), action);
+    if (action->key().isValid()) {
+        lane->queuedKeys.insert(action->key(), action->id());
+    }
+    m_actionLanes.insert(action->id(), lane);
+    m_statistics->actionQueued(action->id(), action->type(), lane->accountId);
+    journalAction(action.data());
+}
+
+void EmailAgent::journalAction(const EmailAction *action)
+{
+    const QVariantMap parameters = action->parameters();
+    if (m_journal && !parameters.isEmpty()) {
+        ActionJournal::Entry entry;
+        entry.name = action->key().name;
+        entry.parameters = parameters;
+        entry.priority = action->priority();
+        // Resumed actions keep their age
+        entry.created = m_journalCreated ? m_journalCreated : QDateTime::currentMSecsSinceEpoch();
+        m_journal->add(action->id(), entry);
+    }
+}
+
+bool EmailAgent::unqueueAction(quint64 actionId)
+{
+    ActionLane *lane = m_actionLanes.take(actionId);
+    if (!lane) {
+        return false;
+    }
+
+    QSharedPointer<EmailAction> action = lane->queuedActions.take(actionId);
+    QHash<EmailAction::Key, quint64>::iterator it = lane->queuedKeys.find(action->key());
+    if (it != lane->queuedKeys.end() && it.value() == actionId) {
+        lane->queuedKeys.erase(it);
+    }
+    lane->retries.remove(actionId);
+    if (m_journal) {
+        m_journal->remove(actionId);
+    }
+    // Finished actions are already counted, the rest were dropped from the queue
+    m_statistics->actionFinished(actionId, ActionStatistics::Cancelled);
+    return true;
+}
+
+void EmailAgent::replayJournal()
+{
+    const QList<ActionJournal::Entry> entries = m_journal->takeEntries(MaximumJournalAge);
+    if (entries.isEmpty()) {
+        return;
+    }
+
+    m_enqueing = true;
+    int resumed = 0;
+    for (const ActionJournal::Entry &entry : entries) {
+        EmailAction *action = journaledAction(entry.name, entry.parameters);
+        if (!action) {
+            qCDebug(lcEmail) << "Not resuming" << entry.name << "as its target is gone";
+            continue;
         }
+        m_journalCreated = entry.created;
+        enqueue(action, EmailAction::Priority(entry.priority));
+        resumed++;
     }
-    return quint64(0);
+    m_journalCreated = 0;
+    m_enqueing = false;
+
+    qCDebug(lcEmail) << "Resumed" << resumed << "of" << entries.count() << "journaled actions";
+    startLanes();
 }
 
-void EmailAgent::dequeue()
+EmailAction *EmailAgent::journaledAction(const QString &name, const QVariantMap &parameters)
 {
-    if (!m_actionQueue.isEmpty()) {
-        m_actionQueue.removeFirst();
+    QMailStore *store = QMailStore::instance();
+
+    const QMailAccountId accountId(parameters.value(QStringLiteral("accountId")).toULongLong());
+    const QMailFolderId folderId(parameters.value(QStringLiteral("folderId")).toULongLong());
+    const QMailFolderId parentId(parameters.value(QStringLiteral("parentId")).toULongLong());
+
+    // Messages removed meanwhile are left out, the rest runs on the lane of their account
+    QMailMessageIdList messageIds;
+    QMailAccountId messagesAccountId;
+    if (parameters.contains(QStringLiteral("messageIds"))) {
+        for (const QVariant &id : parameters.value(QStringLiteral("messageIds")).toList()) {
+            messageIds.append(QMailMessageId(id.toULongLong()));
+        }
+        const QMap<QMailAccountId, QMailMessageIdList> accountMap = messageIdsByAccount(messageIds);
+        messageIds.clear();
+        for (const QMailMessageIdList &ids : accountMap) {
+            messageIds += ids;
+        }
+        if (messageIds.isEmpty()) {
+            return 0;
+        }
+        if (accountMap.count() == 1) {
+            messagesAccountId = accountMap.firstKey();
+        }
     }
+
+    if (name == QLatin1String("exporting-updates")) {
+        if (store->account(accountId).id().isValid()) {
+            return new ExportUpdates(retrievalAction(accountId), accountId);
+        }
+    } else if (name == QLatin1String("transmit-messages")) {
+        if (store->account(accountId).id().isValid()) {
+            return new TransmitMessages(transmitAction(accountId), accountId);
+        }
+    } else if (name == QLatin1String("transmit-message")) {
+        // Sending it again once it has left the outbox would duplicate it
+        const QMailMessageMetaData message(QMailMessageId(parameters.value(QStringLiteral("messageId")).toULongLong()));
+        if (message.id().isValid() && (message.status() & QMailMessage::Outbox)) {
+            return new TransmitMessage(transmitAction(message.parentAccountId()), message.id());
+        }
+    } else if (name == QLatin1String("retrieve-message-part")) {
+        const QMailMessagePart::Location location(parameters.value(QStringLiteral("location")).toString());
+        const QMailMessage message(location.containingMessageId());
+        if (message.id().isValid() && message.contains(location) && !message.partAt(location).hasBody()) {
+            return new RetrieveMessagePart(retrievalAction(message.parentAccountId()), location, true);
+        }
+    } else if (name == QLatin1String("delete-messages")) {
+        return new DeleteMessages(storageAction(messagesAccountId), messageIds);
+    } else if (name == QLatin1String("flag-messages")) {
+        return new FlagMessages(storageAction(messagesAccountId), messageIds,
+                                parameters.value(QStringLiteral("setMask")).toULongLong(),
+                                parameters.value(QStringLiteral("unsetMask")).toULongLong());
+    } else if (name == QLatin1String("move-messages-to-folder")) {
+        if (store->folder(folderId).id().isValid()) {
+            return new MoveToFolder(storageAction(messagesAccountId), messageIds, folderId);
+        }
+    } else if (name == QLatin1String("create-folder")) {
+        if (store->account(accountId).id().isValid()) {
+            return new OnlineCreateFolder(storageAction(accountId), parameters.value(QStringLiteral("name")).toString(),
+                                          accountId, parentId);
+        }
+    } else if (name == QLatin1String("delete-folder")) {
+        const QMailFolder folder = store->folder(folderId);
+        if (folder.id().isValid()) {
+            return new OnlineDeleteFolder(storageAction(folder.parentAccountId()), folderId);
+        }
+    } else if (name == QLatin1String("rename-folder")) {
+        const QMailFolder folder = store->folder(folderId);
+        if (folder.id().isValid()) {
+            return new OnlineRenameFolder(storageAction(folder.parentAccountId()), folderId,
+                                          parameters.value(QStringLiteral("name")).toString());
+        }
+    } else if (name == QLatin1String("move-folder")) {
+        const QMailFolder folder = store->folder(folderId);
+        if (folder.id().isValid()) {
+            return new OnlineMoveFolder(storageAction(folder.parentAccountId()), folderId, parentId);
+        }
+    } else {
+        qCWarning(lcEmail) << "Unknown journaled action" << name;
+    }
+    return 0;
 }
 
-quint64 EmailAgent::enqueue(EmailAction *actionPointer)
+quint64 EmailAgent::enqueue(EmailAction *actionPointer, EmailAction::Priority priority)
 {
     Q_ASSERT(actionPointer);
     QSharedPointer<EmailAction> action(actionPointer);
-    bool foundAction = actionInQueue(action);
+    if (priority != EmailAction::DefaultPriority) {
+        action->setPriority(priority);
+    }
+    // Callers pick the service actions of the lane the action runs on
+    ActionLane *lane = m_serviceActionLanes.value(action->serviceAction());
+    Q_ASSERT(lane);
+    bool foundAction = actionInQueue(lane, action);
 
 #ifdef OFFLINE
     if (!foundAction) {
@@ -1228,19 +2156,18 @@ quint64 EmailAgent::enqueue(EmailAction *actionPointer)
                 }
             }
 
-            m_actionQueue.append(action);
+            queueAction(lane, action);
 
-            if (!m_enqueing && m_currentAction.isNull()) {
-                // Nothing is running, start first action.
-                m_currentAction = getNext();
-                executeCurrent();
+            if (!m_enqueing) {
+                // Start the lanes with nothing running
+                startLanes();
             }
         }
         return action->id();
     } else {
         qCDebug(lcEmail) << "This request already exists in the queue:" << action->description();
-        qCDebug(lcEmail) << "Number of actions in the queue:" << m_actionQueue.size();
-        return actionInQueueId(action);
+        qCDebug(lcEmail) << "Number of actions in the queue:" << lane->queuedActions.size();
+        return actionInQueueId(lane, action);
     }
 #else
 
@@ -1266,36 +2193,147 @@ quint64 EmailAgent::enqueue(EmailAction *actionPointer)
             }
         }
 
-        m_actionQueue.append(action);
+        queueAction(lane, action);
+    } else {
+        // Asking again with a higher priority moves the queued action up
+        QSharedPointer<EmailAction> queued = lane->queuedActions.value(actionInQueueId(lane, action));
+        if (queued && queued != lane->currentAction && queued->priority() < action->priority()) {
+            lane->actionQueues[queued->priority()].removeOne(queued);
+            queued->setPriority(action->priority());
+            lane->actionQueues[queued->priority()].append(queued);
+        }
     }
 
-    if (!m_enqueing && (m_currentAction.isNull() || !m_currentAction->serviceAction()->isRunning())) {
-        // Nothing is running or current action is in waiting state, start first action.
-        QSharedPointer<EmailAction> nextAction = getNext();
-        if (m_currentAction.isNull() || (!nextAction.isNull() && (*(m_currentAction.data()) != *(nextAction.data())))) {
-            m_currentAction = nextAction;
-            executeCurrent();
-        }
+    preemptBackgroundAction(lane, action);
+
+    if (!m_enqueing) {
+        // Batches enqueued before may have filled several lanes
+        startLanes();
     }
 
     if (!foundAction) {
         return action->id();
     } else {
         qCDebug(lcEmail) << "This request already exists in the queue:" << action->description();
-        qCDebug(lcEmail) << "Number of actions in the queue:" << m_actionQueue.size();
-        return actionInQueueId(action);
+        qCDebug(lcEmail) << "Number of actions in the queue:" << lane->queuedActions.size();
+        return actionInQueueId(lane, action);
     }
 #endif
 }
 
-void EmailAgent::executeCurrent()
+void EmailAgent::preemptBackgroundAction(ActionLane *lane, QSharedPointer<EmailAction> action)
+{
+    const QSharedPointer<EmailAction> &currentAction = lane->currentAction;
+    if (!m_preemptBackground || lane->preempting || currentAction.isNull()
+            || action->priority() != EmailAction::InteractivePriority
+            || currentAction->priority() != EmailAction::BackgroundPriority
+            || *(currentAction.data()) == *(action.data())
+            || currentAction->preemptCount() >= MaximumPreemptions
+            || !currentAction->serviceAction()->isRunning()) {
+        return;
+    }
+
+    // Only retrievals are safe to run again from the start
+    if (currentAction->type() != EmailAction::Retrieve && currentAction->type() != EmailAction::RetrieveFolderList) {
+        return;
+    }
+
+    qCDebug(lcEmail) << "Preempting" << currentAction->description() << "for" << action->description();
+    lane->preempting = true;
+    currentAction->serviceAction()->cancelOperation();
+}
+
+bool EmailAgent::scheduleRetry(ActionLane *lane, QMailServiceAction::Status::ErrorCode errorCode)
 {
-    Q_ASSERT (!m_currentAction.isNull());
+    if (errorCode != QMailServiceAction::Status::ErrTimeout
+            && errorCode != QMailServiceAction::Status::ErrNoConnection
+            && errorCode != QMailServiceAction::Status::ErrConnectionNotReady) {
+        return false;
+    }
+
+    const QSharedPointer<EmailAction> &action = lane->currentAction;
+    const EmailAction::RetryPolicy policy = EmailAction::retryPolicy(action->type());
+    ActionLane::Retry &retry = lane->retries[action->id()];
+    if (retry.attempts >= policy.maximumAttempts) {
+        lane->retries.remove(action->id());
+        return false;
+    }
+
+    retry.attempts++;
+    const qint64 delay = qMin(qint64(policy.maximumDelay), qint64(policy.initialDelay) << (retry.attempts - 1));
+    // Half of the delay is jitter, keeping actions failed together from retrying together.
+    // The nanoseconds of the failure time are random enough for that.
+    const qint64 jitter = m_retryClock.nsecsElapsed() % (delay / 2 + 1);
+    retry.due = m_retryClock.elapsed() + delay / 2 + jitter;
+
+    qCDebug(lcEmail) << "Retrying" << action->description() << "in" << (delay / 2 + jitter)
+                     << "ms, attempt" << retry.attempts << "of" << policy.maximumAttempts;
+    m_statistics->actionRetried(action->id());
+
+    // Waiting again, the final failure is reported when retries run out
+    if (action->type() == EmailAction::RetrieveMessagePart) {
+        RetrieveMessagePart* messagePartAction = static_cast<RetrieveMessagePart *>(action.data());
+        if (messagePartAction->isAttachment()) {
+            updateAttachmentDownloadStatus(messagePartAction->partLocation(), Queued);
+        }
+    }
+
+    scheduleRetryTimer();
+    return true;
+}
+
+void EmailAgent::scheduleRetryTimer()
+{
+    const qint64 now = m_retryClock.elapsed();
+    qint64 due = -1;
+    for (const ActionLane *lane : lanes()) {
+        for (const ActionLane::Retry &retry : lane->retries) {
+            if (retry.due > now && (due < 0 || retry.due < due)) {
+                due = retry.due;
+            }
+        }
+    }
+
+    if (due < 0) {
+        m_retryTimer->stop();
+    } else {
+        m_retryTimer->start(int(due - now));
+    }
+}
+
+void EmailAgent::retryFailedActions()
+{
+    startLanes();
+    scheduleRetryTimer();
+}
+
+void EmailAgent::startLanes()
+{
+    for (ActionLane *lane : lanes()) {
+        if (!lane->currentAction.isNull() && lane->currentAction->serviceAction()->isRunning()) {
+            continue;
+        }
+
+        // Nothing is running or current action is in waiting state, start first action.
+        QSharedPointer<EmailAction> nextAction = getNext(lane);
+        if (nextAction.isNull()) {
+            continue;
+        }
+        if (lane->currentAction.isNull() || (*(lane->currentAction.data()) != *(nextAction.data()))) {
+            lane->currentAction = nextAction;
+            executeCurrent(lane);
+        }
+    }
+}
+
+void EmailAgent::executeCurrent(ActionLane *lane)
+{
+    Q_ASSERT (!lane->currentAction.isNull());
 
     if (!QMailStore::instance()->isIpcConnectionEstablished()) {
         qCWarning(lcEmail) << "Ipc connection not established, can't execute service action";
         m_waitForIpc = true;
-    } else if (m_currentAction->needsNetworkConnection() && !isOnline()) {
+    } else if (lane->currentAction->needsNetworkConnection() && !isOnline()) {
         qCDebug(lcEmail) << "Current action not executed, waiting for network";
     } else {
         if (!m_synchronizing) {
@@ -1303,72 +2341,106 @@ void EmailAgent::executeCurrent()
             emit synchronizingChanged();
         }
 
-        QMailAccountId aId = m_currentAction->accountId();
+        QMailAccountId aId = lane->accountId;
         if (aId.isValid() && m_accountSynchronizing != aId.toULongLong()) {
             m_accountSynchronizing = aId.toULongLong();
             emit currentSynchronizingAccountIdChanged();
         }
 
-        qCDebug(lcEmail) << "Executing action:" << m_currentAction->description();
+        qCDebug(lcEmail) << "Executing action:" << lane->currentAction->description();
 
         // Attachment download
-        if (m_currentAction->type() == EmailAction::RetrieveMessagePart) {
-            RetrieveMessagePart* messagePartAction = static_cast<RetrieveMessagePart *>(m_currentAction.data());
+        if (lane->currentAction->type() == EmailAction::RetrieveMessagePart) {
+            RetrieveMessagePart* messagePartAction = static_cast<RetrieveMessagePart *>(lane->currentAction.data());
             if (messagePartAction->isAttachment()) {
                 updateAttachmentDownloadStatus(messagePartAction->partLocation(), Downloading);
             }
-        } else if (m_currentAction->type() == EmailAction::Transmit) {
-            m_transmitting = true;
         }
-        m_currentAction->execute();
+        if (lane->currentAction->type() == EmailAction::Search) {
+            m_searchActionGeneration = m_searchGeneration;
+        }
+        m_statistics->actionStarted(lane->currentAction->id());
+        lane->currentAction->execute();
     }
 }
 
-QSharedPointer<EmailAction> EmailAgent::getNext()
+QSharedPointer<EmailAction> EmailAgent::getNext(ActionLane *lane)
 {
-    if (m_actionQueue.isEmpty())
-        return QSharedPointer<EmailAction>();
+    QSharedPointer<EmailAction> firstAction;
+    const bool online = isOnline();
+    const qint64 now = m_retryClock.elapsed();
+
+    for (int priority = lane->actionQueues.size() - 1; priority >= 0; priority--) {
+        QList<QSharedPointer<EmailAction> > &actionQueue = lane->actionQueues[priority];
+        while (!actionQueue.isEmpty() && !lane->queuedActions.contains(actionQueue.first()->id())) {
+            actionQueue.removeFirst();
+        }
 
-    QSharedPointer<EmailAction> firstAction = m_actionQueue.first();
-    // if we are offline move the first offline action to the top of the queue if one exists
-    if (!isOnline() && firstAction->needsNetworkConnection() && m_actionQueue.size() > 1) {
-        for (int i = 1; i < m_actionQueue.size(); i++) {
-            QSharedPointer<EmailAction> action = m_actionQueue.at(i);
-            if (!action->needsNetworkConnection()) {
-                m_actionQueue.move(i, 0);
+        for (int i = 0; i < actionQueue.size(); i++) {
+            QSharedPointer<EmailAction> action = actionQueue.at(i);
+            // Removed actions and retries not yet due are passed over
+            if (!lane->queuedActions.contains(action->id()) || lane->retries.value(action->id()).due > now)
+                continue;
+
+            if (online || !action->needsNetworkConnection()) {
+                // if we are offline move the first offline action to the top of its queue
+                if (!online && i > 0)
+                    actionQueue.move(i, 0);
                 return action;
             }
+
+            if (firstAction.isNull())
+                firstAction = action;
         }
     }
+    // Offline with only online actions left, the first one waits for the network
     return firstAction;
 }
 
-void EmailAgent::cancelCurrentAction()
+void EmailAgent::cancelCurrentAction(ActionLane *lane)
 {
-    if (m_currentAction->serviceAction()->isRunning()) {
-        m_cancellingSingleAction = true;
-        m_currentAction->serviceAction()->cancelOperation();
+    if (lane->currentAction->serviceAction()->isRunning()) {
+        lane->cancellingSingleAction = true;
+        lane->currentAction->serviceAction()->cancelOperation();
     } else {
-        processNextAction();
+        processNextAction(lane);
     }
 }
 
-void EmailAgent::processNextAction()
+void EmailAgent::processNextAction(ActionLane *lane)
 {
-    m_currentAction = getNext();
-    if (m_currentAction.isNull()) {
-        qCDebug(lcEmail) << "Sync completed.";
-        bool wasSynchronizing = m_synchronizing;
-        m_synchronizing = false;
-        if (m_accountSynchronizing != 0) {
-            m_accountSynchronizing = 0;
-            emit currentSynchronizingAccountIdChanged();
+    lane->currentAction = getNext(lane);
+    if (!lane->currentAction.isNull()) {
+        executeCurrent(lane);
+        return;
+    }
+
+    // Retries still waiting keep the account in its sync round
+    if (lane->queuedActions.isEmpty() && m_runningSyncs.contains(lane->accountId)) {
+        finishAccountSync(lane->accountId);
+    }
+
+    // Other lanes may still be busy
+    for (const ActionLane *other : lanes()) {
+        if (!other->currentAction.isNull()) {
+            if (lane->accountId.isValid() && m_accountSynchronizing == lane->accountId.toULongLong()
+                    && other->accountId.isValid()) {
+                m_accountSynchronizing = other->accountId.toULongLong();
+                emit currentSynchronizingAccountIdChanged();
+            }
+            return;
         }
-        if (wasSynchronizing)
-            emit synchronizingChanged();
-    } else {
-        executeCurrent();
     }
+
+    qCDebug(lcEmail) << "Sync completed.";
+    bool wasSynchronizing = m_synchronizing;
+    m_synchronizing = false;
+    if (m_accountSynchronizing != 0) {
+        m_accountSynchronizing = 0;
+        emit currentSynchronizingAccountIdChanged();
+    }
+    if (wasSynchronizing)
+        emit synchronizingChanged();
 }
 
 quint64 EmailAgent::newAction()
@@ -1427,14 +2499,7 @@ void EmailAgent::reportError(const QMailAccountId &accountId, const QMailService
 
 void EmailAgent::removeAction(quint64 actionId)
 {
-    for (int i = 0; i < m_actionQueue.size();) {
-        if (m_actionQueue.at(i).data()->id() == actionId) {
-            m_actionQueue.removeAt(i);
-            return;
-        } else {
-            ++i;
-        }
-    }
+    unqueueAction(actionId);
 }
 
 bool EmailAgent::saveAttachmentToDownloads(const QMailMessageId &messageId, const QString &attachmentLocation)
@@ -11,7 +11,11 @@
 #ifndef EMAILAGENT_H
 #define EMAILAGENT_H
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
 #include <QSharedPointer>
+#include <QVector>
 #include <QNetworkConfigurationManager>
 
 #include <qmailaccount.h>
@@ -20,7 +24,14 @@
 
 #include "emailaction.h"
 
+class ActionJournal;
+class ActionStatistics;
+class BodySearchIndex;
 class FolderAccessor;
+class HeaderSearchIndex;
+class MessageFieldWriter;
+class SearchCoordinator;
+class QTimer;
 
 class Q_DECL_EXPORT EmailAgent : public QObject
 {
@@ -33,6 +44,9 @@ class Q_DECL_EXPORT EmailAgent : public QObject
     Q_ENUMS(OnlineFolderAction)
     Q_PROPERTY(bool synchronizing READ synchronizing NOTIFY synchronizingChanged)
     Q_PROPERTY(int currentSynchronizingAccountId READ currentSynchronizingAccountId NOTIFY currentSynchronizingAccountIdChanged)
+    Q_PROPERTY(int savedExports READ savedExports NOTIFY savedExportsChanged)
+    Q_PROPERTY(QVariantMap actionStatistics READ actionStatistics NOTIFY actionStatisticsChanged)
+    Q_PROPERTY(double accountsSyncProgress READ accountsSyncProgress NOTIFY accountsSyncProgressChanged)
 
 public:
     static EmailAgent *instance();
@@ -92,23 +106,65 @@ public:
     QString attachmentTitle(const QMailMessagePart &part) const;
     QString bodyPlainText(const QMailMessage &mailMsg) const;
     void cancelAction(quint64 actionId);
-    quint64 downloadMessages(const QMailMessageIdList &messageIds, QMailRetrievalAction::RetrievalSpecification spec);
-    quint64 downloadMessagePart(const QMailMessagePartContainer::Location &location);
+    quint64 downloadMessages(const QMailMessageIdList &messageIds, QMailRetrievalAction::RetrievalSpecification spec,
+                             EmailAction::Priority priority = EmailAction::DefaultPriority);
+    quint64 downloadMessagePart(const QMailMessagePartContainer::Location &location,
+                                EmailAction::Priority priority = EmailAction::DefaultPriority);
+    // Exports are delayed until the account had no new local changes for the given time
     void exportUpdates(const QMailAccountIdList &accountIdList);
+    int exportUpdatesDelay() const;
+    void setExportUpdatesDelay(int milliseconds);
+    int savedExports() const;
+    Q_INVOKABLE void flushPendingExports();
     bool hasMessagesInOutbox(const QMailAccountId &accountId);
     void initMailServer();
     bool ipcConnected();
     Q_INVOKABLE bool isOnline();
     void searchMessages(const QMailMessageKey &filter, const QString &bodyText, QMailSearchAction::SearchSpecification spec,
                         quint64 limit, bool searchBody, const QMailMessageSortKey &sort = QMailMessageSortKey());
+    // Remote search running on the accounts in parallel
+    void searchRemoteMessages(const QMailAccountIdList &accountIds, const QMailMessageKey &filter,
+                              const QString &bodyText, quint64 limit, bool searchBody,
+                              const QMailMessageSortKey &sort = QMailMessageSortKey());
+    int remoteSearchConcurrency() const;
+    void setRemoteSearchConcurrency(int count);
+    // Seconds remote search results are reused, zero disables caching
+    int remoteSearchCacheTimeToLive() const;
+    void setRemoteSearchCacheTimeToLive(int seconds);
     void cancelSearch();
+    // Changes whenever a search is started or cancelled. Matched ids are only
+    // reported for the search of the current generation.
+    quint64 searchGeneration() const;
+    HeaderSearchIndex *headerSearchIndex() const;
+    MessageFieldWriter *messageFieldWriter() const;
     void cancelAll();
     bool synchronizing() const;
+    // Interactive actions cancel a running background retrieval of their account, which is run again later
+    bool preemptBackgroundActions() const;
+    void setPreemptBackgroundActions(bool preempt);
+    // Queue wait and run times, outcomes and queue depth per action type and account
+    QVariantMap actionStatistics() const;
+    Q_INVOKABLE void resetActionStatistics();
+    // Seconds between the statistics written to the log, zero disables them
+    int actionStatisticsDumpInterval() const;
+    void setActionStatisticsDumpInterval(int seconds);
     void flagMessages(const QMailMessageIdList &ids, quint64 setMask, quint64 unsetMask);
     void moveMessages(const QMailMessageIdList &ids, const QMailFolderId &destinationId);
+    void moveMessages(const QMailMessageKey &key, const QMailFolderId &destinationId);
     void sendMessage(const QMailMessageId &messageId);
     void sendMessages(const QMailAccountId &accountId);
     void setMessagesReadState(const QMailMessageIdList &ids, bool state);
+    void setMessagesReadState(const QMailMessageKey &key, bool state);
+    QMailAccountIdList accountIdsForMessages(const QMailMessageKey &key) const;
+    // Groups the messages by parent account with a single store query
+    QMap<QMailAccountId, QMailMessageIdList> messageIdsByAccount(const QMailMessageIdList &ids) const;
+    QMap<QMailAccountId, QMailMessageIdList> messageIdsByAccount(const QMailMessageKey &key) const;
+
+    // Accounts synchronized side by side by accountsSyncInbox() and accountsSyncAllFolders()
+    int accountsSyncConcurrency() const;
+    void setAccountsSyncConcurrency(int count);
+    // Share of the accounts of the running accountsSync round done, one when idle
+    double accountsSyncProgress() const;
 
     void setupAccountFlags();
     int standardFolderId(int accountId, QMailFolder::StandardFolder folder) const;
@@ -120,6 +176,7 @@ public:
     Q_INVOKABLE void deleteMessage(int messageId);
     Q_INVOKABLE void deleteMessagesFromVariantList(const QVariantList &ids);
     void deleteMessages(const QMailMessageIdList &ids);
+    void deleteMessages(const QMailMessageKey &key);
     Q_INVOKABLE void expungeMessages(const QMailMessageIdList &ids);
     Q_INVOKABLE bool downloadAttachment(int messageId, const QString &attachmentLocation);
     Q_INVOKABLE void cancelAttachmentDownload(const QString &attachmentLocation);
@@ -157,6 +214,9 @@ public:
 
 signals:
     void currentSynchronizingAccountIdChanged();
+    void savedExportsChanged();
+    void actionStatisticsChanged();
+    void accountsSyncProgressChanged();
     void attachmentDownloadProgressChanged(const QString &attachmentLocation, double progress);
     void attachmentDownloadStatusChanged(const QString &attachmentLocation, EmailAgent::AttachmentStatus status);
     void attachmentPathChanged(const QString &attachmentLocation, const QString &filepath);
@@ -172,6 +232,8 @@ signals:
     void searchMessageIdsMatched(const QMailMessageIdList &ids);
     void searchCompleted(const QString &search, const QMailMessageIdList &matchedIds, bool isRemote,
                          int remainingMessagesOnRemote, EmailAgent::SearchStatus status);
+    void searchAccountCompleted(const QString &search, const QMailAccountId &accountId,
+                                const QMailMessageIdList &matchedIds, int remainingMessagesOnRemote);
     void calendarInvitationResponded(CalendarInvitationResponse response, bool success);
     void onlineFolderActionCompleted(OnlineFolderAction action, bool success);
 
@@ -179,32 +241,116 @@ private slots:
     void activityChanged(QMailServiceAction::Activity activity);
     void onIpcConnectionEstablished();
     void onOnlineStateChanged(bool isOnline);
+    void onSearchMessageIdsMatched(const QMailMessageIdList &ids);
+    void onRemoteSearchCompleted(const QString &search, const QMailMessageIdList &matchedIds,
+                                 int remainingMessagesOnRemote, bool success);
     void progressChanged(uint value, uint total);
+    void onAccountsRemoved(const QMailAccountIdList &ids);
+    void onApplicationStateChanged(Qt::ApplicationState state);
+    void exportPendingUpdates();
+    void retryFailedActions();
 
 private:
+    // Actions of one account run one at a time in their queue order, each account
+    // having its own service actions so that different accounts progress side by side.
+    // The local lane takes the actions not bound to a single account.
+    struct ActionLane {
+        ActionLane()
+            : retrievalAction(0),
+              storageAction(0),
+              transmitAction(0),
+              protocolAction(0),
+              cancellingSingleAction(false),
+              preempting(false),
+              interrupted(false)
+        {}
+
+        struct Retry {
+            Retry() : attempts(0), due(0) {}
+
+            int attempts;
+            qint64 due;
+        };
+
+        QMailAccountId accountId;
+        QMailRetrievalAction *retrievalAction;
+        QMailStorageAction *storageAction;
+        QMailTransmitAction *transmitAction;
+        QMailProtocolAction *protocolAction;
+        // One queue per priority. Removed actions are only dropped from the index,
+        // the queues skip them when reached.
+        QVector<QList<QSharedPointer<EmailAction> > > actionQueues;
+        QHash<quint64, QSharedPointer<EmailAction> > queuedActions;
+        QHash<EmailAction::Key, quint64> queuedKeys;
+        // Actions failed on the connection, passed over until due
+        QHash<quint64, Retry> retries;
+        QSharedPointer<EmailAction> currentAction;
+        bool cancellingSingleAction;
+        bool preempting;
+        // Cancelled for losing the network, runs again once back online
+        bool interrupted;
+    };
+
     static EmailAgent *m_instance;
 
     uint m_actionCount;
     quint64 m_accountSynchronizing;
-    bool m_transmitting;
-    bool m_cancellingSingleAction;
     bool m_synchronizing;
     bool m_enqueing;
     bool m_waitForIpc;
+    bool m_preemptBackground;
 
     QMailAccountIdList m_enabledAccounts;
 
-    QScopedPointer<QMailRetrievalAction> const m_retrievalAction;
-    QScopedPointer<QMailStorageAction> const m_storageAction;
-    QScopedPointer<QMailTransmitAction> const m_transmitAction;
     QScopedPointer<QMailSearchAction> const m_searchAction;
-    QScopedPointer<QMailProtocolAction> const m_protocolAction;
-    QMailRetrievalAction *m_attachmentRetrievalAction;
+
+    BodySearchIndex *m_bodySearchIndex;
+    HeaderSearchIndex *m_headerSearchIndex;
+    MessageFieldWriter *m_messageFieldWriter;
+    SearchCoordinator *m_searchCoordinator;
+    quint64 m_searchGeneration;
+    // Generation the search action was started in
+    quint64 m_searchActionGeneration;
 
     QNetworkConfigurationManager *m_nmanager;
 
-    QList<QSharedPointer<EmailAction> > m_actionQueue;
-    QSharedPointer<EmailAction> m_currentAction;
+    ActionLane *m_localLane;
+    QHash<QMailAccountId, ActionLane *> m_accountLanes;
+    QHash<QObject *, ActionLane *> m_serviceActionLanes;
+    QHash<quint64, ActionLane *> m_actionLanes;
+
+    struct PendingExport {
+        qint64 firstRequest;
+        qint64 due;
+    };
+    QHash<QMailAccountId, PendingExport> m_pendingExports;
+    QTimer *m_exportTimer;
+    QElapsedTimer m_exportClock;
+    int m_exportUpdatesDelay;
+    int m_savedExports;
+
+    // Shared by the process, 0 in agents other than the one owning it
+    ActionJournal *m_journal;
+    // Creation time kept by the actions being resumed
+    qint64 m_journalCreated;
+
+    ActionStatistics *m_statistics;
+
+    QTimer *m_retryTimer;
+    QElapsedTimer m_retryClock;
+
+    struct PendingSync {
+        QMailAccountId accountId;
+        bool inboxOnly;
+        uint minimum;
+    };
+    QList<PendingSync> m_pendingSyncs;
+    // Progress of the accounts being synchronized, from their service actions
+    QHash<QMailAccountId, double> m_runningSyncs;
+    int m_accountsSyncConcurrency;
+    int m_syncAccountCount;
+    int m_syncedAccountCount;
+
     struct AttachmentInfo {
         AttachmentInfo()
             : status(Unknown),
@@ -220,20 +366,45 @@ private:
     QHash<QString, AttachmentInfo> m_attachmentDownloadQueue;
 
     void accountsSync(bool syncOnlyInbox = false, uint minimum = 20);
-    bool actionInQueue(QSharedPointer<EmailAction> action) const;
-    quint64 actionInQueueId(QSharedPointer<EmailAction> action) const;
-    void dequeue();
-    quint64 enqueue(EmailAction *action);
-    void executeCurrent();
-    QSharedPointer<EmailAction> getNext();
-    void cancelCurrentAction();
-    void processNextAction();
+    void sortPendingSyncs();
+    void dispatchAccountSyncs();
+    void finishAccountSync(const QMailAccountId &accountId);
+    ActionLane *createLane(const QMailAccountId &accountId);
+    ActionLane *lane(const QMailAccountId &accountId);
+    QList<ActionLane *> lanes() const;
+    QMailRetrievalAction *retrievalAction(const QMailAccountId &accountId);
+    QMailStorageAction *storageAction(const QMailAccountId &accountId);
+    QMailTransmitAction *transmitAction(const QMailAccountId &accountId);
+    QMailProtocolAction *protocolAction(const QMailAccountId &accountId);
+    bool isTransmitting() const;
+    bool actionInQueue(ActionLane *lane, QSharedPointer<EmailAction> action) const;
+    quint64 actionInQueueId(ActionLane *lane, QSharedPointer<EmailAction> action) const;
+    void dequeue(ActionLane *lane);
+    quint64 enqueue(EmailAction *action, EmailAction::Priority priority = EmailAction::DefaultPriority);
+    void enqueueExportUpdates(const QMailAccountIdList &accountIdList);
+    void dropPendingExport(const QMailAccountId &accountId);
+    void scheduleExportTimer();
+    void preemptBackgroundAction(ActionLane *lane, QSharedPointer<EmailAction> action);
+    bool scheduleRetry(ActionLane *lane, QMailServiceAction::Status::ErrorCode errorCode);
+    void scheduleRetryTimer();
+    void queueAction(ActionLane *lane, QSharedPointer<EmailAction> action);
+    void journalAction(const EmailAction *action);
+    bool unqueueAction(quint64 actionId);
+    void replayJournal();
+    EmailAction *journaledAction(const QString &name, const QVariantMap &parameters);
+    void executeCurrent(ActionLane *lane);
+    QSharedPointer<EmailAction> getNext(ActionLane *lane);
+    void cancelCurrentAction(ActionLane *lane);
+    void processNextAction(ActionLane *lane);
+    void startLanes();
     quint64 newAction();
     void reportError(const QMailAccountId &accountId, const QMailServiceAction::Status::ErrorCode &errorCode, bool sendFailed);
     void removeAction(quint64 actionId);
     bool saveAttachmentToDownloads(const QMailMessageId &messageId, const QString &attachmentLocation);
     void updateAttachmentDownloadStatus(const QString &attachmentLocation, AttachmentStatus status);
     void emitSearchStatusChanges(QSharedPointer<EmailAction> action, EmailAgent::SearchStatus status);
+    bool searchBodyIndex(const QMailMessageKey &filter, const QString &bodyText,
+                         quint64 limit, const QMailMessageSortKey &sort);
     bool easCalendarInvitationResponse(const QMailMessage &message, CalendarInvitationResponse response,
                                        const QString &responseSubject);
 };
@@ -1282,7 +1282,8 @@ void EmailMessage::requestInlinePartsDownload(const QMap<QString, QMailMessagePa
     QMapIterator<QString, QMailMessagePartContainer::Location> iter(inlineParts);
     while (iter.hasNext()) {
         iter.next();
-        EmailAgent::instance()->downloadMessagePart(iter.value());
+        // Below the body the message is opened for
+        EmailAgent::instance()->downloadMessagePart(iter.value(), EmailAction::UserInitiatedPriority);
     }
 }
 
@@ -8,6 +8,9 @@
  * http://www.apache.org/licenses/LICENSE-2.0
  */
 
+#include <algorithm>
+#include <iterator>
+
 #include <QDateTime>
 
 #include <qmailmessage.h>
@@ -18,12 +21,75 @@
 #include <qmailnamespace.h>
 
 #include "emailmessagelistmodel.h"
+#include "headersearchindex.h"
+#include "messagefieldwriter.h"
+#include "subjectutils.h"
 #include "logging_p.h"
 
+namespace {
+
+// Number of rows whose metadata is kept decoded in memory
+const int MessageCacheSize = 1000;
+
+// Larger result sets are not worth narrowing a refined search with
+const int MaxRefinedResults = 5000;
+
+// Store notifications are collected for about one frame before the views hear of them
+const int NotificationInterval = 16;
+
+// Rows loaded by the first step of asynchronous population, doubled on each following step
+const uint PopulationPageSize = 50;
+
+// Without a limit, asynchronous population stops here and the view fetches the rest as it scrolls
+const uint MaxPopulatedRows = 1600;
+
+// Rows added by each fetch past the populated ones
+const uint FetchMorePageSize = 200;
+
+// Result rows whose sort fields are loaded by a single query when the sort order changes
+const int ResultSortBatchSize = 500;
+
+// Message properties needed to fill a row of the cache
+const QMailMessageKey::Properties MessageDataProperties = QMailMessageKey::Id
+        | QMailMessageKey::Status
+        | QMailMessageKey::Sender
+        | QMailMessageKey::Recipients
+        | QMailMessageKey::TimeStamp
+        | QMailMessageKey::Subject
+        | QMailMessageKey::Preview
+        | QMailMessageKey::Size
+        | QMailMessageKey::ParentFolderId
+        | QMailMessageKey::ParentAccountId
+        | QMailMessageKey::Custom;
+
+template <typename T>
+int compareValues(const T &left, const T &right)
+{
+    return left < right ? -1 : (right < left ? 1 : 0);
+}
+
+int compareFlag(quint64 left, quint64 right, quint64 flag)
+{
+    return compareValues((left & flag) != 0, (right & flag) != 0);
+}
+
+QString sizeText(uint size)
+{
+    if (size < 1024) {
+        return QObject::tr("%n byte(s)", "", size);
+    } else if (size < 1024 * 1024) {
+        return QObject::tr("%1 KB").arg(size / 1024.0, 0, 'f', 1);
+    }
+    return QObject::tr("%1 MB").arg(size / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+}
+
 EmailMessageListModel::EmailMessageListModel(QObject *parent)
     : QMailMessageListModel(parent),
       m_combinedInbox(false),
       m_canFetchMore(false),
+      m_limit(0),
       m_searchLimit(100),
       m_searchOn(EmailMessageListModel::LocalAndRemote),
       m_searchFrom(true),
@@ -32,7 +98,18 @@ EmailMessageListModel::EmailMessageListModel(QObject *parent)
       m_searchBody(true),
       m_searchRemainingOnRemote(0),
       m_searchCanceled(false),
-      m_folderAccessor(new FolderAccessor(this))
+      m_searchGeneration(0),
+      m_showingResults(false),
+      m_folderAccessor(new FolderAccessor(this)),
+      m_messageCache(MessageCacheSize),
+      m_prefetchLookAhead(50),
+      m_rowIndexValid(false),
+      m_asyncPopulation(false),
+      m_populating(false),
+      m_fetchMoreCheckPending(false),
+      m_pendingNotifications(0),
+      m_coalescedNotifications(0),
+      m_keyMessageCount(-1)
 {
     roles[QMailMessageModelBase::MessageAddressTextRole] = "sender";
     roles[QMailMessageModelBase::MessageSubjectTextRole] = "subject";
@@ -70,6 +147,7 @@ EmailMessageListModel::EmailMessageListModel(QObject *parent)
     m_key = key();
     m_sortKey = QMailMessageSortKey::timeStamp(Qt::DescendingOrder);
     m_sortBy = Time;
+    m_sortOrder = Qt::DescendingOrder;
     QMailMessageListModel::setSortKey(m_sortKey);
 
     connect(this, SIGNAL(rowsInserted(QModelIndex,int,int)),
@@ -79,20 +157,59 @@ EmailMessageListModel::EmailMessageListModel(QObject *parent)
     connect(this, SIGNAL(modelReset()),
             this, SIGNAL(countChanged()));
 
+    // Connected before any view, so cached rows are dropped before the views read them again
+    connect(this, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)),
+            this, SLOT(onDataChanged(QModelIndex,QModelIndex,QVector<int>)));
+    connect(this, SIGNAL(rowsInserted(QModelIndex,int,int)),
+            this, SLOT(onRowsInserted(QModelIndex,int,int)));
+    connect(this, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)),
+            this, SLOT(onRowsAboutToBeRemoved(QModelIndex,int,int)));
+    connect(this, SIGNAL(modelReset()),
+            this, SLOT(invalidateRowIndex()));
+    connect(this, SIGNAL(layoutChanged()),
+            this, SLOT(invalidateRowIndex()));
+    connect(this, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)),
+            this, SLOT(invalidateRowIndex()));
+
     connect(QMailStore::instance(), SIGNAL(messagesAdded(QMailMessageIdList)),
             this, SLOT(messagesAdded(QMailMessageIdList)));
 
     connect(QMailStore::instance(), SIGNAL(messagesRemoved(QMailMessageIdList)),
             this, SLOT(messagesRemoved(QMailMessageIdList)));
 
+    connect(QMailStore::instance(), SIGNAL(messagesUpdated(QMailMessageIdList)),
+            this, SLOT(messagesUpdated(QMailMessageIdList)));
+
+    // Retrieved content can complete headers and part structure of cached rows
+    connect(QMailStore::instance(), SIGNAL(messageContentsModified(QMailMessageIdList)),
+            this, SLOT(messagesUpdated(QMailMessageIdList)));
+
     connect(QMailStore::instance(), SIGNAL(accountsUpdated(QMailAccountIdList)),
             this, SLOT(accountsChanged()));
 
     connect(EmailAgent::instance(), SIGNAL(searchCompleted(QString,const QMailMessageIdList&,bool,int,EmailAgent::SearchStatus)),
             this, SLOT(onSearchCompleted(QString,const QMailMessageIdList&,bool,int,EmailAgent::SearchStatus)));
 
+    connect(EmailAgent::instance(), SIGNAL(searchMessageIdsMatched(const QMailMessageIdList&)),
+            this, SLOT(onSearchMessageIdsMatched(const QMailMessageIdList&)));
+
+    connect(EmailAgent::instance(), SIGNAL(searchAccountCompleted(QString,QMailAccountId,QMailMessageIdList,int)),
+            this, SLOT(onSearchAccountCompleted(QString,QMailAccountId,QMailMessageIdList,int)));
+
     m_remoteSearchTimer.setSingleShot(true);
     connect(&m_remoteSearchTimer, SIGNAL(timeout()), this, SLOT(searchOnline()));
+
+    m_populationTimer.setSingleShot(true);
+    m_populationTimer.setInterval(0);
+    connect(&m_populationTimer, SIGNAL(timeout()), this, SLOT(populateMore()));
+
+    m_notificationTimer.setSingleShot(true);
+    m_notificationTimer.setInterval(NotificationInterval);
+    connect(&m_notificationTimer, SIGNAL(timeout()), this, SLOT(flushNotifications()));
+
+    m_searchStreamTimer.setSingleShot(true);
+    m_searchStreamTimer.setInterval(NotificationInterval);
+    connect(&m_searchStreamTimer, SIGNAL(timeout()), this, SLOT(appendMatchedIds()));
 }
 
 EmailMessageListModel::~EmailMessageListModel()
@@ -106,9 +223,37 @@ QHash<int, QByteArray> EmailMessageListModel::roleNames() const
 
 int EmailMessageListModel::rowCount(const QModelIndex & parent) const
 {
+    if (m_showingResults) {
+        return parent.isValid() ? 0 : m_resultRows.count();
+    }
     return QMailMessageListModel::rowCount(parent);
 }
 
+QModelIndex EmailMessageListModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (m_showingResults) {
+        return hasIndex(row, column, parent) ? createIndex(row, column) : QModelIndex();
+    }
+    return QMailMessageListModel::index(row, column, parent);
+}
+
+QMailMessageId EmailMessageListModel::idFromIndex(const QModelIndex &index) const
+{
+    if (m_showingResults) {
+        return index.isValid() && index.row() < m_resultRows.count() ? m_resultRows.at(index.row()) : QMailMessageId();
+    }
+    return QMailMessageListModel::idFromIndex(index);
+}
+
+QModelIndex EmailMessageListModel::indexFromId(const QMailMessageId &id) const
+{
+    if (m_showingResults) {
+        const int row = rowFromId(id);
+        return row >= 0 ? index(row) : QModelIndex();
+    }
+    return QMailMessageListModel::indexFromId(id);
+}
+
 QVariant EmailMessageListModel::data(const QModelIndex & index, int role) const
 {
     if (!index.isValid() || index.row() > rowCount(parent(index))) {
@@ -130,54 +275,51 @@ QVariant EmailMessageListModel::data(const QModelIndex & index, int role) const
         return body;
     } else if (role == MessageIdRole) {
         return msgId.toULongLong();
-    } else if (role == MessageToRole) {
-        QMailMessage message(msgId);
-        return QMailAddress::toStringList(message.to());
-    } else if (role == MessageCcRole) {
-        QMailMessage message(msgId);
-        return QMailAddress::toStringList(message.cc());
-    } else if (role == MessageBccRole) {
-        QMailMessage message(msgId);
-        return QMailAddress::toStringList(message.bcc());
     } else if (role == MessageSelectModeRole) {
-        return (m_selectedMsgIds.contains(index.row()));
+        return m_selectedMsgIds.contains(msgId);
     }
 
-    QMailMessageMetaData messageMetaData(msgId);
+    MessageData *messageMetaData = messageData(index);
+    if (!messageMetaData) {
+        return m_showingResults ? QVariant() : QMailMessageListModel::data(index, role);
+    }
 
     if (role == QMailMessageModelBase::MessageTimeStampTextRole) {
-        QDateTime timeStamp = messageMetaData.date().toLocalTime();
+        QDateTime timeStamp = messageMetaData->date;
         return (timeStamp.toString("hh:mm MM/dd/yyyy"));
+    } else if (role == MessageToRole) {
+        loadHeaders(msgId, messageMetaData);
+        return messageMetaData->to;
+    } else if (role == MessageCcRole) {
+        loadHeaders(msgId, messageMetaData);
+        return messageMetaData->cc;
+    } else if (role == MessageBccRole) {
+        loadHeaders(msgId, messageMetaData);
+        return messageMetaData->bcc;
     } else if (role == MessageAttachmentCountRole) {
         // return number of attachments
-        if (!(messageMetaData.status() & QMailMessageMetaData::HasAttachments))
+        if (!(messageMetaData->status & QMailMessageMetaData::HasAttachments))
             return 0;
 
-        QMailMessage message(msgId);
-        const QList<QMailMessagePart::Location> &attachmentLocations = message.findAttachmentLocations();
-        return attachmentLocations.count();
+        requestFields(msgId, messageMetaData);
+        return messageMetaData->attachments.count();
     } else if (role == MessageAttachmentsRole) {
         // return a stringlist of attachments
-        if (!(messageMetaData.status() & QMailMessageMetaData::HasAttachments))
+        if (!(messageMetaData->status & QMailMessageMetaData::HasAttachments))
             return QStringList();
 
-        QMailMessage message(msgId);
-        QStringList attachments;
-        for (const QMailMessagePart::Location &location : message.findAttachmentLocations()) {
-            const QMailMessagePart &attachmentPart = message.partAt(location);
-            attachments << attachmentPart.displayName();
-        }
-        return attachments;
+        requestFields(msgId, messageMetaData);
+        return messageMetaData->attachments;
     } else if (role == MessageRecipientsRole) {
         QStringList recipients;
-        QList<QMailAddress> addresses = messageMetaData.recipients();
+        QList<QMailAddress> addresses = messageMetaData->recipients;
         for (const QMailAddress &address : addresses) {
             recipients << address.address();
         }
         return recipients;
     } else if (role == MessageRecipientsDisplayNameRole) {
         QStringList recipients;
-        QList<QMailAddress> addresses = messageMetaData.recipients();
+        QList<QMailAddress> addresses = messageMetaData->recipients;
         for (const QMailAddress &address : addresses) {
             if (address.name().isEmpty()) {
                 recipients << address.address();
@@ -187,39 +329,39 @@ QVariant EmailMessageListModel::data(const QModelIndex & index, int role) const
         }
         return recipients;
     } else if (role == MessageReadStatusRole) {
-        return (messageMetaData.status() & QMailMessage::Read) != 0;
+        return (messageMetaData->status & QMailMessage::Read) != 0;
     } else if (role == MessageSenderDisplayNameRole) {
-        if (messageMetaData.from().name().isEmpty()) {
-            return messageMetaData.from().address();
+        if (messageMetaData->from.name().isEmpty()) {
+            return messageMetaData->from.address();
         } else {
-            return messageMetaData.from().name();
+            return messageMetaData->from.name();
         }
     } else if (role == MessageSenderEmailAddressRole) {
-        return messageMetaData.from().address();
+        return messageMetaData->from.address();
     } else if (role == MessageTimeStampRole) {
-        return messageMetaData.date().toLocalTime();
+        return messageMetaData->date;
     } else if (role == MessagePreviewRole) {
-        return messageMetaData.preview().simplified();
+        return messageMetaData->preview;
     } else if (role == MessageTimeSectionRole) {
-        return messageMetaData.date().toLocalTime().date();
+        return messageMetaData->date.date();
     } else if (role == MessagePriorityRole) {
-        if (messageMetaData.status() & QMailMessage::HighPriority) {
+        if (messageMetaData->status & QMailMessage::HighPriority) {
             return HighPriority;
-        } else if (messageMetaData.status() & QMailMessage::LowPriority) {
+        } else if (messageMetaData->status & QMailMessage::LowPriority) {
             return LowPriority;
         } else {
             return NormalPriority;
         }
     } else if (role == MessageAccountIdRole) {
-        return messageMetaData.parentAccountId().toULongLong();
+        return messageMetaData->accountId.toULongLong();
     } else if (role == MessageHasAttachmentsRole) {
-        return (messageMetaData.status() & QMailMessageMetaData::HasAttachments) != 0;
+        return (messageMetaData->status & QMailMessageMetaData::HasAttachments) != 0;
     } else if (role == MessageHasCalendarInvitationRole) {
-        return (messageMetaData.status() & QMailMessageMetaData::CalendarInvitation) != 0;
+        return (messageMetaData->status & QMailMessageMetaData::CalendarInvitation) != 0;
     } else if (role == MessageHasSignatureRole) {
-        return (messageMetaData.status() & QMailMessageMetaData::HasSignature) != 0;
+        return (messageMetaData->status & QMailMessageMetaData::HasSignature) != 0;
     } else if (role == MessageSizeSectionRole) {
-        const uint size(messageMetaData.size());
+        const uint size(messageMetaData->size);
 
         if (size < 100 * 1024) { // <100 KB
             return 0;
@@ -229,24 +371,150 @@ QVariant EmailMessageListModel::data(const QModelIndex & index, int role) const
             return 2;
         }
     } else if (role == MessageFolderIdRole) {
-        return messageMetaData.parentFolderId().toULongLong();
+        return messageMetaData->folderId.toULongLong();
+    } else if (role == QMailMessageModelBase::MessageSubjectTextRole) {
+        return messageMetaData->subject;
     } else if (role == MessageParsedSubject) {
         // Filter <img> and <ahref> html tags to make the text suitable to be displayed in a qml
         // label using StyledText(allows only small subset of html)
-        QString subject = QMailMessageListModel::data(index, QMailMessageModelBase::MessageSubjectTextRole).toString();
-        subject.replace(QRegExp("<\\s*img", Qt::CaseInsensitive), "<no-img");
-        subject.replace(QRegExp("<\\s*a", Qt::CaseInsensitive), "<no-a");
-        return subject;
+        return messageMetaData->parsedSubject;
     } else if (role == MessageTrimmedSubject) {
-        QString subject = QMailMessageListModel::data(index, QMailMessageModelBase::MessageSubjectTextRole).toString();
-        return subject.replace(QRegExp(QStringLiteral("^(re:|fw:|fwd:|\\s*)*"), Qt::CaseInsensitive), QString());
+        return messageMetaData->trimmedSubject;
     } else if (role == MessageHasCalendarCancellationRole) {
-        return (messageMetaData.status() & QMailMessageMetaData::CalendarCancellation) != 0;
+        return (messageMetaData->status & QMailMessageMetaData::CalendarCancellation) != 0;
+    } else if (m_showingResults) {
+        // Result rows are not known to the base model, its text roles are provided here
+        QString address = messageMetaData->from.toString();
+        if (!(messageMetaData->status & QMailMessage::Incoming) && !messageMetaData->recipients.isEmpty()) {
+            address = messageMetaData->recipients.first().toString();
+        }
+        if (role == QMailMessageModelBase::MessageAddressTextRole) {
+            return address;
+        } else if (role == QMailMessageModelBase::MessageFilterTextRole) {
+            return address + QLatin1Char(' ') + messageMetaData->subject;
+        } else if (role == QMailMessageModelBase::MessageSizeTextRole) {
+            return sizeText(messageMetaData->size);
+        }
+        return QVariant();
     }
 
     return QMailMessageListModel::data(index, role);
 }
 
+EmailMessageListModel::MessageData *EmailMessageListModel::messageData(const QModelIndex &index) const
+{
+    QMailMessageId id = idFromIndex(index);
+    if (MessageData *item = m_messageCache.object(id)) {
+        return item;
+    }
+
+    // Cache miss, most likely the view is scrolling into rows not seen yet.
+    // Load the neighbourhood in one query rather than row by row.
+    prefetchRows(index.row() - m_prefetchLookAhead, index.row() + m_prefetchLookAhead);
+    return m_messageCache.object(id);
+}
+
+EmailMessageListModel::MessageData *EmailMessageListModel::cacheMessageData(const QMailMessageMetaData &metaData) const
+{
+    if (!metaData.id().isValid()) {
+        return nullptr;
+    }
+
+    MessageData *item = new MessageData;
+    item->status = metaData.status();
+    item->from = metaData.from();
+    item->recipients = metaData.recipients();
+    item->date = metaData.date().toLocalTime();
+    item->subject = metaData.subject();
+    item->parsedSubject = SubjectUtils::parsedSubject(item->subject);
+    item->trimmedSubject = SubjectUtils::trimmedSubject(item->subject);
+    item->preview = metaData.preview().simplified();
+    item->size = metaData.size();
+    item->folderId = metaData.parentFolderId();
+    item->accountId = metaData.parentAccountId();
+    item->fieldsWritten = MessageFieldWriter::hasFields(metaData);
+    item->fieldsRequested = false;
+    item->toField = MessageFieldWriter::addressField(metaData, MessageFieldWriter::To);
+    item->ccField = MessageFieldWriter::addressField(metaData, MessageFieldWriter::Cc);
+    item->bccField = MessageFieldWriter::addressField(metaData, MessageFieldWriter::Bcc);
+    item->headersLoaded = false;
+    item->attachments = MessageFieldWriter::attachmentNames(metaData);
+
+    m_messageCache.insert(metaData.id(), item);
+    return item;
+}
+
+void EmailMessageListModel::loadHeaders(const QMailMessageId &id, MessageData *item) const
+{
+    if (item->headersLoaded) {
+        return;
+    }
+
+    // The addresses are written to the metadata when the message is stored. Until then
+    // all recipients stand in for To, the row is updated once the fields are written.
+    if (!item->fieldsWritten) {
+        requestFields(id, item);
+        item->to = QMailAddress::toStringList(item->recipients);
+        return;
+    }
+
+    item->to = MessageFieldWriter::addresses(item->toField);
+    item->cc = MessageFieldWriter::addresses(item->ccField);
+    item->bcc = MessageFieldWriter::addresses(item->bccField);
+    item->headersLoaded = true;
+}
+
+void EmailMessageListModel::requestFields(const QMailMessageId &id, MessageData *item) const
+{
+    // Messages stored before the fields were written get them on first use
+    if (!item->fieldsWritten && !item->fieldsRequested) {
+        item->fieldsRequested = true;
+        EmailAgent::instance()->messageFieldWriter()->request(QMailMessageIdList() << id);
+    }
+}
+
+void EmailMessageListModel::prefetchRows(int firstRow, int lastRow) const
+{
+    firstRow = qMax(firstRow, 0);
+    lastRow = qMin(lastRow, rowCount() - 1);
+
+    QMailMessageIdList ids;
+    for (int row = firstRow; row <= lastRow; row++) {
+        QMailMessageId id = idFromIndex(index(row));
+        if (id.isValid() && !m_messageCache.contains(id)) {
+            ids.append(id);
+        }
+    }
+
+    if (ids.isEmpty()) {
+        return;
+    }
+
+    const QMailMessageMetaDataList metaDataList
+            = QMailStore::instance()->messagesMetaData(QMailMessageKey::id(ids), MessageDataProperties);
+    for (const QMailMessageMetaData &metaData : metaDataList) {
+        cacheMessageData(metaData);
+    }
+}
+
+void EmailMessageListModel::dropRowData(int first, int last)
+{
+    // Result rows are cached from fresh metadata before they are announced
+    if (m_showingResults) {
+        return;
+    }
+    for (int row = first; row <= last; row++) {
+        m_messageCache.remove(idFromIndex(index(row)));
+    }
+}
+
+void EmailMessageListModel::invalidateMessageData(const QMailMessageIdList &ids)
+{
+    for (const QMailMessageId &id : ids) {
+        m_messageCache.remove(id);
+    }
+}
+
 FolderAccessor *EmailMessageListModel::folderAccessor() const
 {
     return m_folderAccessor;
@@ -255,6 +523,13 @@ FolderAccessor *EmailMessageListModel::folderAccessor() const
 void EmailMessageListModel::setFolderAccessor(FolderAccessor *accessor)
 {
     m_folderAccessor->readValues(accessor);
+    hideResults();
+
+    // Have the key and sort key queries below return only the first page,
+    // beginPopulation() leaves the list empty until the new key is set
+    if (m_asyncPopulation) {
+        beginPopulation();
+    }
 
     if (accessor) {
         QMailFolderId mailFolder(accessor->folderId());
@@ -304,11 +579,15 @@ void EmailMessageListModel::setFolderAccessor(FolderAccessor *accessor)
         emit selectedMessageCountChanged();
     }
 
-    if (!m_selectedUnreadIdx.isEmpty()) {
-        m_selectedUnreadIdx.clear();
+    if (!m_selectedUnreadIds.isEmpty()) {
+        m_selectedUnreadIds.clear();
         emit unreadMailsSelectedChanged();
     }
 
+    if (m_populating) {
+        m_populationTimer.start();
+    }
+
     checkFetchMoreChanged();
     emit folderAccessorChanged();
 }
@@ -328,28 +607,40 @@ void EmailMessageListModel::setSearch(const QString &search)
     // TODO: could bail out if search string didn't change, but then changing search properties
     // should retrigger search.
 
+    // Remote search for the previous term would be superseded anyway
+    m_remoteSearchTimer.stop();
+    resetMatchedIds();
+
     if (search.isEmpty()) {
         // TODO: this should return the model content to what it was before searching,
         // so the feature could be used with any kind of folder access. Now this assumes
         // account wide search mode.
         m_searchKey = QMailMessageKey::nonMatchingKey();
+        m_lastResults = SearchResults();
+        hideResults();
         setKey(m_searchKey);
         m_search = search;
         cancelSearch();
     } else {
-        QMailMessageKey tempKey;
+        QMailMessageKey headerKey;
+        HeaderSearchIndex::Fields headerFields;
         if (m_searchFrom) {
-            tempKey |= QMailMessageKey::sender(search, QMailDataComparator::Includes);
+            headerKey |= QMailMessageKey::sender(search, QMailDataComparator::Includes);
+            headerFields |= HeaderSearchIndex::Sender;
         }
         if (m_searchRecipients) {
-            tempKey |= QMailMessageKey::recipients(search, QMailDataComparator::Includes);
+            headerKey |= QMailMessageKey::recipients(search, QMailDataComparator::Includes);
+            headerFields |= HeaderSearchIndex::Recipients;
         }
         if (m_searchSubject) {
-            tempKey |= QMailMessageKey::subject(search, QMailDataComparator::Includes);
+            headerKey |= QMailMessageKey::subject(search, QMailDataComparator::Includes);
+            headerFields |= HeaderSearchIndex::Subject;
         }
+        QMailMessageKey bodyKey;
         if (m_searchBody) {
-            tempKey |= QMailMessageKey::preview(search, QMailDataComparator::Includes);
+            bodyKey = QMailMessageKey::preview(search, QMailDataComparator::Includes);
         }
+        QMailMessageKey tempKey = headerKey | bodyKey;
 
         m_searchCanceled = false;
 
@@ -365,24 +656,340 @@ void EmailMessageListModel::setSearch(const QString &search)
         }
 
         m_searchKey = QMailMessageKey(m_key & tempKey);
+        m_searchStarted = QDateTime::currentDateTimeUtc();
         m_search = search;
         setSearchRemainingOnRemote(0);
+        m_searchRemainingByAccount.clear();
 
         if (m_searchOn == EmailMessageListModel::Remote) {
-            setKey(QMailMessageKey::nonMatchingKey());
-            EmailAgent::instance()->searchMessages(m_searchKey, m_search, QMailSearchAction::Remote,
-                                                   m_searchLimit, m_searchBody);
+            m_lastResults = SearchResults();
+            showResults(QMailMessageIdList());
+            EmailAgent::instance()->searchRemoteMessages(searchAccountIds(), m_searchKey, m_search,
+                                                         m_searchLimit, m_searchBody);
+            m_searchGeneration = EmailAgent::instance()->searchGeneration();
         } else {
-            setKey(m_searchKey);
+            // When typing extends the previous term, only its matches and the messages
+            // received since can match again, so scan just those instead of the whole
+            // folder. Remote search keeps the full key.
+            QMailMessageKey scope = m_key;
+            if (canRefineSearch(search)) {
+                qCDebug(lcEmail) << "Refining search within" << m_lastResults.ids.count() << "previous results";
+                scope = m_key & (QMailMessageKey::id(m_lastResults.ids)
+                                 | QMailMessageKey::receptionTimeStamp(m_lastResults.started,
+                                                                       QMailDataComparator::GreaterThanEqual));
+            }
+
+            // Header fields are resolved from the trigram index when it can answer,
+            // leaving the store to intersect the matches with the folder key.
+            HeaderSearchIndex *headerIndex = EmailAgent::instance()->headerSearchIndex();
+            QMailMessageKey localKey = tempKey;
+            QMailMessageIdList headerIds;
+            if (headerFields && headerIndex->search(search, headerFields, searchAccountIds(), &headerIds)) {
+                localKey = (headerIds.isEmpty() ? QMailMessageKey::nonMatchingKey() : QMailMessageKey::id(headerIds))
+                        | bodyKey;
+            }
+            const QMailMessageKey localSearchKey(scope & localKey);
+
+            // The search key is evaluated once, later pages and new messages are merged into the rows
+            showResults(QMailStore::instance()->queryMessages(localSearchKey, m_sortKey));
+
             // We have model filtering already via searchKey, so when doing body search we pass just the
             // current model key plus body search, otherwise results will be merged and just entries with both,
             // fields and body matches will be returned.
-            EmailAgent::instance()->searchMessages(m_searchBody ? m_key : m_searchKey, m_search,
+            EmailAgent::instance()->searchMessages(m_searchBody ? scope : localSearchKey, m_search,
                                                    QMailSearchAction::Local, m_searchLimit, m_searchBody);
+            m_searchGeneration = EmailAgent::instance()->searchGeneration();
         }
     }
 }
 
+// Every field, the body included, matches the text as a case insensitive substring,
+// so a text containing the previous one can only match messages the previous one did
+bool EmailMessageListModel::canRefineSearch(const QString &search) const
+{
+    return m_lastResults.valid
+            && !m_lastResults.search.isEmpty()
+            && search.contains(m_lastResults.search, Qt::CaseInsensitive)
+            && m_lastResults.folderKey == m_key
+            && m_lastResults.from == m_searchFrom
+            && m_lastResults.recipients == m_searchRecipients
+            && m_lastResults.subject == m_searchSubject
+            && m_lastResults.body == m_searchBody;
+}
+
+void EmailMessageListModel::storeSearchResults(const QString &search, bool complete)
+{
+    m_lastResults = SearchResults();
+
+    if (!complete || m_resultIds.count() > MaxRefinedResults) {
+        return;
+    }
+
+    m_lastResults.ids = m_resultIds;
+    m_lastResults.search = search;
+    m_lastResults.folderKey = m_key;
+    m_lastResults.from = m_searchFrom;
+    m_lastResults.recipients = m_searchRecipients;
+    m_lastResults.subject = m_searchSubject;
+    m_lastResults.body = m_searchBody;
+    m_lastResults.started = m_searchStarted;
+    m_lastResults.valid = true;
+}
+
+void EmailMessageListModel::mergeResultIds(const QMailMessageIdList &ids)
+{
+    if (!m_showingResults) {
+        return;
+    }
+
+    QMailMessageIdList newIds;
+    for (const QMailMessageId &id : ids) {
+        if (!std::binary_search(m_resultIds.constBegin(), m_resultIds.constEnd(), id)) {
+            newIds.append(id);
+        }
+    }
+    if (newIds.isEmpty()) {
+        return;
+    }
+
+    // Only the new ids are checked against the folder key, the query also brings
+    // the fields they are placed among the rows by
+    addResults(QMailStore::instance()->messagesMetaData(m_key & QMailMessageKey::id(newIds), MessageDataProperties));
+}
+
+void EmailMessageListModel::showResults(const QMailMessageIdList &rows)
+{
+    // The base model is left empty while the results are listed by this model
+    if (!m_showingResults) {
+        QMailMessageListModel::setKey(QMailMessageKey::nonMatchingKey());
+    }
+
+    beginResetModel();
+    m_showingResults = true;
+    m_resultRows = rows;
+    m_resultIds = rows;
+    std::sort(m_resultIds.begin(), m_resultIds.end());
+    endResetModel();
+}
+
+void EmailMessageListModel::hideResults()
+{
+    if (!m_showingResults) {
+        return;
+    }
+
+    beginResetModel();
+    m_showingResults = false;
+    m_resultRows.clear();
+    m_resultIds.clear();
+    endResetModel();
+}
+
+void EmailMessageListModel::addResults(const QMailMessageMetaDataList &metaDataList)
+{
+    QMailMessageIdList newIds;
+    for (const QMailMessageMetaData &metaData : metaDataList) {
+        const QMailMessageId id(metaData.id());
+        if (std::binary_search(m_resultIds.constBegin(), m_resultIds.constEnd(), id)) {
+            continue;
+        }
+        MessageData *item = cacheMessageData(metaData);
+        if (!item) {
+            continue;
+        }
+        newIds.append(id);
+
+        // Copied, looking up the neighbouring rows can evict it from the cache
+        const MessageData rowData(*item);
+        const int row = resultPosition(rowData);
+        beginInsertRows(QModelIndex(), row, row);
+        m_resultRows.insert(row, id);
+        endInsertRows();
+    }
+
+    std::sort(newIds.begin(), newIds.end());
+    QMailMessageIdList merged;
+    merged.reserve(m_resultIds.count() + newIds.count());
+    std::merge(m_resultIds.constBegin(), m_resultIds.constEnd(),
+               newIds.constBegin(), newIds.constEnd(), std::back_inserter(merged));
+    m_resultIds = merged;
+}
+
+void EmailMessageListModel::removeResults(const QMailMessageIdList &ids)
+{
+    QSet<QMailMessageId> removed;
+    for (const QMailMessageId &id : ids) {
+        QMailMessageIdList::iterator it = std::lower_bound(m_resultIds.begin(), m_resultIds.end(), id);
+        if (it != m_resultIds.end() && *it == id) {
+            m_resultIds.erase(it);
+            removed.insert(id);
+        }
+    }
+    if (removed.isEmpty()) {
+        return;
+    }
+
+    // One pass from the end, a signal per contiguous range of rows
+    int row = m_resultRows.count() - 1;
+    while (row >= 0) {
+        if (!removed.contains(m_resultRows.at(row))) {
+            row--;
+            continue;
+        }
+        int first = row;
+        while (first > 0 && removed.contains(m_resultRows.at(first - 1))) {
+            first--;
+        }
+        beginRemoveRows(QModelIndex(), first, row);
+        m_resultRows.erase(m_resultRows.begin() + first, m_resultRows.begin() + row + 1);
+        endRemoveRows();
+        row = first - 1;
+    }
+}
+
+void EmailMessageListModel::updateResults(const QMailMessageIdList &ids)
+{
+    QMailMessageIdList resultIds;
+    for (const QMailMessageId &id : ids) {
+        if (std::binary_search(m_resultIds.constBegin(), m_resultIds.constEnd(), id)) {
+            resultIds.append(id);
+        }
+    }
+    if (resultIds.isEmpty()) {
+        return;
+    }
+
+    // Results moved out of the folder are dropped, the others keep their place unless
+    // the change affects the sort order
+    const QMailMessageMetaDataList metaDataList
+            = QMailStore::instance()->messagesMetaData(m_key & QMailMessageKey::id(resultIds), MessageDataProperties);
+    QSet<QMailMessageId> remaining;
+    for (const QMailMessageMetaData &metaData : metaDataList) {
+        remaining.insert(metaData.id());
+        MessageData *item = cacheMessageData(metaData);
+        const int row = rowFromId(metaData.id());
+        if (!item || row < 0) {
+            continue;
+        }
+
+        const MessageData rowData(*item);
+        const MessageData *previous = row > 0 ? messageData(index(row - 1)) : 0;
+        const bool beforePrevious = previous && lessThan(rowData, *previous);
+        const MessageData *next = row + 1 < m_resultRows.count() ? messageData(index(row + 1)) : 0;
+        if (!beforePrevious && !(next && lessThan(*next, rowData))) {
+            continue;
+        }
+
+        beginRemoveRows(QModelIndex(), row, row);
+        m_resultRows.removeAt(row);
+        endRemoveRows();
+        const int newRow = resultPosition(rowData);
+        beginInsertRows(QModelIndex(), newRow, newRow);
+        m_resultRows.insert(newRow, metaData.id());
+        endInsertRows();
+    }
+
+    QMailMessageIdList movedIds;
+    for (const QMailMessageId &id : resultIds) {
+        if (!remaining.contains(id)) {
+            movedIds.append(id);
+        }
+    }
+    removeResults(movedIds);
+}
+
+void EmailMessageListModel::sortResults()
+{
+    // Sort fields are loaded in bounded batches rather than with a key listing every result
+    QHash<QMailMessageId, MessageData> items;
+    items.reserve(m_resultRows.count());
+    for (int i = 0; i < m_resultRows.count(); i += ResultSortBatchSize) {
+        const QMailMessageIdList batch = m_resultRows.mid(i, ResultSortBatchSize);
+        const QMailMessageMetaDataList metaDataList
+                = QMailStore::instance()->messagesMetaData(QMailMessageKey::id(batch), MessageDataProperties);
+        for (const QMailMessageMetaData &metaData : metaDataList) {
+            if (MessageData *item = cacheMessageData(metaData)) {
+                items.insert(metaData.id(), *item);
+            }
+        }
+    }
+
+    beginResetModel();
+    std::stable_sort(m_resultRows.begin(), m_resultRows.end(),
+                     [this, &items](const QMailMessageId &left, const QMailMessageId &right) {
+        QHash<QMailMessageId, MessageData>::const_iterator leftItem = items.constFind(left);
+        QHash<QMailMessageId, MessageData>::const_iterator rightItem = items.constFind(right);
+        if (leftItem == items.constEnd() || rightItem == items.constEnd()) {
+            return leftItem != items.constEnd() && rightItem == items.constEnd();
+        }
+        return lessThan(*leftItem, *rightItem);
+    });
+    endResetModel();
+}
+
+int EmailMessageListModel::resultPosition(const MessageData &item) const
+{
+    // Binary search for the row after the last one not sorting after the item
+    int first = 0;
+    int last = m_resultRows.count();
+    while (first < last) {
+        const int middle = first + (last - first) / 2;
+        const MessageData *other = messageData(index(middle));
+        if (!other || !lessThan(item, *other)) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    return first;
+}
+
+// The order of the model sort key, for placing result rows in memory
+bool EmailMessageListModel::lessThan(const MessageData &left, const MessageData &right) const
+{
+    int order = 0;
+    switch (m_sortBy) {
+    case Attachments:
+        order = compareFlag(left.status, right.status, QMailMessage::HasAttachments);
+        break;
+    case Priority:
+        // Low priority goes the opposite way, see sortByOrder()
+        order = compareFlag(left.status, right.status, QMailMessage::HighPriority);
+        if (!order) {
+            order = -compareFlag(left.status, right.status, QMailMessage::LowPriority);
+        }
+        break;
+    case ReadStatus:
+        order = compareFlag(left.status, right.status, QMailMessage::Read);
+        break;
+    case Recipients:
+        order = compareValues(QMailAddress::toStringList(left.recipients).join(QLatin1String(", ")),
+                              QMailAddress::toStringList(right.recipients).join(QLatin1String(", ")));
+        break;
+    case Sender:
+        order = compareValues(left.from.toString(), right.from.toString());
+        break;
+    case Size:
+        order = compareValues(left.size, right.size);
+        break;
+    case Subject:
+        order = compareValues(left.subject, right.subject);
+        break;
+    case Time:
+        order = compareValues(left.date, right.date);
+        break;
+    }
+
+    if (m_sortOrder == Qt::DescendingOrder) {
+        order = -order;
+    }
+    // Secondary order of the sort key, newest first
+    if (!order && m_sortBy != Time) {
+        order = compareValues(right.date, left.date);
+    }
+    return order < 0;
+}
+
 void EmailMessageListModel::cancelSearch()
 {
     // Cancel also remote search since it can be trigger later by the timer
@@ -397,7 +1004,22 @@ EmailMessageListModel::Sort EmailMessageListModel::sortBy() const
 
 bool EmailMessageListModel::unreadMailsSelected() const
 {
-    return !m_selectedUnreadIdx.isEmpty();
+    return !m_selectedUnreadIds.isEmpty();
+}
+
+int EmailMessageListModel::prefetchLookAhead() const
+{
+    return m_prefetchLookAhead;
+}
+
+void EmailMessageListModel::setPrefetchLookAhead(int rows)
+{
+    // Prefetched rows must fit the cache along with the visible ones
+    rows = qBound(0, rows, MessageCacheSize / 4);
+    if (rows != m_prefetchLookAhead) {
+        m_prefetchLookAhead = rows;
+        emit prefetchLookAheadChanged();
+    }
 }
 
 void EmailMessageListModel::setSortBy(EmailMessageListModel::Sort sort)
@@ -455,30 +1077,146 @@ void EmailMessageListModel::sortByOrder(Qt::SortOrder sortOrder, EmailMessageLis
     }
 
     m_sortBy = sortBy;
+    m_sortOrder = sortOrder;
 
     if (sortBy != Time) {
         m_sortKey &= QMailMessageSortKey::timeStamp(Qt::DescendingOrder);
     }
-    QMailMessageListModel::setSortKey(m_sortKey);
+
+    if (m_showingResults) {
+        // The base model is empty, only the result rows need sorting
+        QMailMessageListModel::setSortKey(m_sortKey);
+        sortResults();
+    } else if (m_asyncPopulation) {
+        const QMailMessageKey currentKey = key();
+        beginPopulation();
+        QMailMessageListModel::setSortKey(m_sortKey);
+        QMailMessageListModel::setKey(currentKey);
+    } else {
+        QMailMessageListModel::setSortKey(m_sortKey);
+    }
+    if (m_populating) {
+        m_populationTimer.start();
+    }
     emit sortByChanged();
 }
 
 int EmailMessageListModel::indexFromMessageId(int messageId)
 {
-    QMailMessageId msgId(messageId);
-    for (int row = 0; row < rowCount(); row++) {
-        QVariant vMsgId = data(index(row), QMailMessageModelBase::MessageIdRole);
-        
-        if (msgId == vMsgId.value<QMailMessageId>())
-            return row;
+    return rowFromId(QMailMessageId(messageId));
+}
+
+int EmailMessageListModel::rowFromId(const QMailMessageId &id) const
+{
+    if (!m_rowIndexValid) {
+        m_rowIndex.clear();
+        m_rowIndex.reserve(rowCount());
+        for (int row = 0; row < rowCount(); row++) {
+            m_rowIndex.insert(idFromIndex(index(row)), row);
+        }
+        m_rowIndexValid = true;
+    }
+
+    return m_rowIndex.value(id, -1);
+}
+
+void EmailMessageListModel::onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight,
+                                          const QVector<int> &roles)
+{
+    // Changes without roles come from the base model following the store
+    if (roles.isEmpty()) {
+        dropRowData(topLeft.row(), bottomRight.row());
+    }
+}
+
+void EmailMessageListModel::onRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) {
+        return;
+    }
+    // An updated message may come back in at its new sort position
+    dropRowData(first, last);
+
+    if (!m_rowIndexValid) {
+        return;
+    }
+
+    // Appending (e.g. fetching more) keeps the existing rows, anything else
+    // shifts them and the index gets rebuilt on the next lookup.
+    if (last == rowCount() - 1) {
+        for (int row = first; row <= last; row++) {
+            m_rowIndex.insert(idFromIndex(index(row)), row);
+        }
+    } else {
+        invalidateRowIndex();
+    }
+}
+
+void EmailMessageListModel::onRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (!m_rowIndexValid || parent.isValid()) {
+        return;
+    }
+
+    if (last == rowCount() - 1) {
+        for (int row = first; row <= last; row++) {
+            m_rowIndex.remove(idFromIndex(index(row)));
+        }
+    } else {
+        invalidateRowIndex();
     }
-    return -1;
+}
+
+void EmailMessageListModel::invalidateRowIndex()
+{
+    m_rowIndexValid = false;
+    m_rowIndex.clear();
+}
+
+void EmailMessageListModel::prefetch(int firstRow, int lastRow)
+{
+    prefetchRows(firstRow - m_prefetchLookAhead, lastRow + m_prefetchLookAhead);
 }
 
 void EmailMessageListModel::selectAllMessages()
 {
-    for (int row = 0; row < rowCount(); row++) {
-        selectMessage(row);
+    const int count = rowCount();
+    if (count == 0)
+        return;
+
+    const int previousCount = m_selectedMsgIds.size();
+    const bool unreadSelected = !m_selectedUnreadIds.isEmpty();
+
+    // Read status comes from the row cache where available, the rest
+    // is resolved with a single query instead of loading every row.
+    QMailMessageIdList uncachedIds;
+    m_selectedMsgIds.reserve(count);
+    for (int row = 0; row < count; row++) {
+        QMailMessageId id = idFromIndex(index(row));
+        m_selectedMsgIds.insert(id);
+        if (const MessageData *item = m_messageCache.object(id)) {
+            if (!(item->status & QMailMessage::Read)) {
+                m_selectedUnreadIds.insert(id);
+            }
+        } else {
+            uncachedIds.append(id);
+        }
+    }
+
+    if (!uncachedIds.isEmpty()) {
+        QMailMessageKey unreadKey(QMailMessageKey::id(uncachedIds)
+                                  & QMailMessageKey::status(QMailMessage::Read, QMailDataComparator::Excludes));
+        for (const QMailMessageId &id : QMailStore::instance()->queryMessages(unreadKey)) {
+            m_selectedUnreadIds.insert(id);
+        }
+    }
+
+    emit dataChanged(index(0), index(count - 1), QVector<int>() << MessageSelectModeRole);
+    if (m_selectedMsgIds.size() != previousCount) {
+        emit selectedMessageCountChanged();
+    }
+    if (m_selectedUnreadIds.isEmpty() == unreadSelected) {
+        emit unreadMailsSelectedChanged();
     }
 }
 
@@ -487,51 +1225,140 @@ void EmailMessageListModel::deselectAllMessages()
     if (m_selectedMsgIds.isEmpty())
         return;
 
-    QMutableMapIterator<int, QMailMessageId> iter(m_selectedMsgIds);
-    while (iter.hasNext()) {
-        iter.next();
-        int idx = iter.key();
-        iter.remove();
-        dataChanged(index(idx), index(idx), QVector<int>() << MessageSelectModeRole);
+    // Map the selection to rows and announce it as contiguous ranges
+    QBitArray rows(rowCount());
+    for (const QMailMessageId &id : m_selectedMsgIds) {
+        int row = rowFromId(id);
+        if (row >= 0) {
+            rows.setBit(row);
+        }
+    }
+
+    m_selectedMsgIds.clear();
+    emitRowsChanged(rows, QVector<int>() << MessageSelectModeRole);
+
+    if (!m_selectedUnreadIds.isEmpty()) {
+        m_selectedUnreadIds.clear();
+        emit unreadMailsSelectedChanged();
     }
-    m_selectedUnreadIdx.clear();
-    emit unreadMailsSelectedChanged();
     emit selectedMessageCountChanged();
 }
 
 void EmailMessageListModel::selectMessage(int idx)
 {
     QMailMessageId msgId = idFromIndex(index(idx));
+    if (!msgId.isValid() || m_selectedMsgIds.contains(msgId))
+        return;
 
-    if (!m_selectedMsgIds.contains(idx)) {
-        m_selectedMsgIds.insert(idx, msgId);
-        dataChanged(index(idx), index(idx), QVector<int>() << MessageSelectModeRole);
-        emit selectedMessageCountChanged();
+    m_selectedMsgIds.insert(msgId);
+    emit dataChanged(index(idx), index(idx), QVector<int>() << MessageSelectModeRole);
+    emit selectedMessageCountChanged();
+
+    const MessageData *item = messageData(index(idx));
+    if (item && !(item->status & QMailMessage::Read)) {
+        m_selectedUnreadIds.insert(msgId);
+        if (m_selectedUnreadIds.size() == 1) {
+            emit unreadMailsSelectedChanged();
+        }
     }
+}
+
+void EmailMessageListModel::deselectMessage(int idx)
+{
+    QMailMessageId msgId = idFromIndex(index(idx));
+    if (!m_selectedMsgIds.remove(msgId))
+        return;
+
+    emit dataChanged(index(idx), index(idx), QVector<int>() << MessageSelectModeRole);
+    emit selectedMessageCountChanged();
 
-    bool messageRead = data(index(idx), MessageReadStatusRole).toBool();
-    if (m_selectedUnreadIdx.isEmpty() && !messageRead) {
-        m_selectedUnreadIdx.append(idx);
+    if (m_selectedUnreadIds.remove(msgId) && m_selectedUnreadIds.isEmpty()) {
         emit unreadMailsSelectedChanged();
-    } else if (!messageRead) {
-        m_selectedUnreadIdx.append(idx);
     }
 }
 
-void EmailMessageListModel::deselectMessage(int idx)
+int EmailMessageListModel::emitRowsChanged(const QBitArray &rows, const QVector<int> &roles)
 {
-    if (m_selectedMsgIds.contains(idx)) {
-        m_selectedMsgIds.remove(idx);
-        dataChanged(index(idx), index(idx), QVector<int>() << MessageSelectModeRole);
-        emit selectedMessageCountChanged();
+    const int count = qMin(rows.size(), rowCount());
+    int ranges = 0;
+    int row = 0;
+    while (row < count) {
+        if (!rows.testBit(row)) {
+            row++;
+            continue;
+        }
+        int last = row;
+        while (last + 1 < count && rows.testBit(last + 1)) {
+            last++;
+        }
+        emit dataChanged(index(row), index(last), roles);
+        ranges++;
+        row = last + 1;
     }
+    return ranges;
+}
 
-    if (m_selectedUnreadIdx.contains(idx)) {
-        m_selectedUnreadIdx.removeOne(idx);
-        if (m_selectedUnreadIdx.isEmpty()) {
-            emit unreadMailsSelectedChanged();
+void EmailMessageListModel::updateSelectedMessages(const QMailMessageIdList &ids, bool removed)
+{
+    if (m_selectedMsgIds.isEmpty())
+        return;
+
+    QMailMessageIdList selectedIds;
+    for (const QMailMessageId &id : ids) {
+        if (m_selectedMsgIds.contains(id)) {
+            selectedIds.append(id);
+        }
+    }
+    if (selectedIds.isEmpty())
+        return;
+
+    const bool unreadSelected = !m_selectedUnreadIds.isEmpty();
+    for (const QMailMessageId &id : selectedIds) {
+        m_selectedUnreadIds.remove(id);
+        if (removed) {
+            m_selectedMsgIds.remove(id);
         }
     }
+
+    if (removed) {
+        emit selectedMessageCountChanged();
+    } else {
+        // Read status of selected messages may have changed
+        QMailMessageKey unreadKey(QMailMessageKey::id(selectedIds)
+                                  & QMailMessageKey::status(QMailMessage::Read, QMailDataComparator::Excludes));
+        for (const QMailMessageId &id : QMailStore::instance()->queryMessages(unreadKey)) {
+            m_selectedUnreadIds.insert(id);
+        }
+    }
+
+    if (m_selectedUnreadIds.isEmpty() == unreadSelected) {
+        emit unreadMailsSelectedChanged();
+    }
+}
+
+// Every message the key matches has a row, so the bulk operations can pass the model
+// key and let the store resolve the messages instead of listing their ids. Not while
+// rows are still being populated or the limit cuts them off, nor for search results,
+// which the base key does not match. The store count catches messages which arrived
+// but have no row yet, it is kept until the key or the store changes.
+bool EmailMessageListModel::listsAllMessages() const
+{
+    const int count = rowCount();
+    if (m_showingResults || m_populating || count == 0 || (limit() && uint(count) >= limit())) {
+        return false;
+    }
+
+    const QMailMessageKey modelKey(key());
+    if (m_keyMessageCount < 0 || !(m_countedKey == modelKey)) {
+        m_countedKey = modelKey;
+        m_keyMessageCount = QMailStore::instance()->countMessages(modelKey);
+    }
+    return m_keyMessageCount == count;
+}
+
+bool EmailMessageListModel::allMessagesSelected() const
+{
+    return m_selectedMsgIds.size() == rowCount() && listsAllMessages();
 }
 
 void EmailMessageListModel::moveSelectedMessages(int folderId)
@@ -540,8 +1367,10 @@ void EmailMessageListModel::moveSelectedMessages(int folderId)
         return;
 
     const QMailFolderId id(folderId);
-    if (id.isValid()) {
-        EmailAgent::instance()->moveMessages(m_selectedMsgIds.values(), id);
+    if (id.isValid() && allMessagesSelected()) {
+        EmailAgent::instance()->moveMessages(key(), id);
+    } else if (id.isValid()) {
+        EmailAgent::instance()->moveMessages(m_selectedMsgIds.toList(), id);
     }
     deselectAllMessages();
 }
@@ -551,7 +1380,11 @@ void EmailMessageListModel::deleteSelectedMessages()
     if (m_selectedMsgIds.empty())
         return;
 
-    EmailAgent::instance()->deleteMessages(m_selectedMsgIds.values());
+    if (allMessagesSelected()) {
+        EmailAgent::instance()->deleteMessages(key());
+    } else {
+        EmailAgent::instance()->deleteMessages(m_selectedMsgIds.toList());
+    }
     deselectAllMessages();
 }
 
@@ -560,7 +1393,11 @@ void EmailMessageListModel::markAsReadSelectedMessages()
     if (m_selectedMsgIds.empty())
         return;
 
-    EmailAgent::instance()->setMessagesReadState(m_selectedMsgIds.values(), true);
+    if (allMessagesSelected()) {
+        EmailAgent::instance()->setMessagesReadState(key(), true);
+    } else {
+        EmailAgent::instance()->setMessagesReadState(m_selectedMsgIds.toList(), true);
+    }
     deselectAllMessages();
 }
 
@@ -569,37 +1406,33 @@ void EmailMessageListModel::markAsUnReadSelectedMessages()
     if (m_selectedMsgIds.empty())
         return;
 
-    EmailAgent::instance()->setMessagesReadState(m_selectedMsgIds.values(), false);
+    if (allMessagesSelected()) {
+        EmailAgent::instance()->setMessagesReadState(key(), false);
+    } else {
+        EmailAgent::instance()->setMessagesReadState(m_selectedMsgIds.toList(), false);
+    }
     deselectAllMessages();
 }
 
 void EmailMessageListModel::markAllMessagesAsRead()
 {
-    if (rowCount()) {
-        QMailAccountIdList accountIdList;
-        QMailMessageIdList msgIds;
-        quint64 status(QMailMessage::Read);
-
-        for (int row = 0; row < rowCount(); row++) {
-            if (!data(index(row), MessageReadStatusRole).toBool()) {
-                QMailMessageId id = (data(index(row), QMailMessageModelBase::MessageIdRole)).value<QMailMessageId>();
-                msgIds.append(id);
-
-                QMailAccountId accountId = (data(index(row), MessageAccountIdRole)).value<QMailAccountId>();
-                if (!accountIdList.contains(accountId)) {
-                    accountIdList.append(accountId);
-                }
+    const int count = rowCount();
+    if (count) {
+        // Operate on the model key directly when it matches just the rows, the store
+        // resolves the affected messages and accounts without walking the rows here.
+        if (listsAllMessages()) {
+            EmailAgent::instance()->setMessagesReadState(key(), true);
+        } else {
+            QMailMessageIdList ids;
+            ids.reserve(count);
+            for (int row = 0; row < count; row++) {
+                ids.append(idFromIndex(index(row)));
             }
-        }
-        if (!msgIds.isEmpty()) {
-            QMailStore::instance()->updateMessagesMetaData(QMailMessageKey::id(msgIds), status, true);
-        }
-        for (const QMailAccountId &accId : accountIdList) {
-            EmailAgent::instance()->exportUpdates(QMailAccountIdList() << accId);
+            EmailAgent::instance()->setMessagesReadState(ids, true);
         }
 
-        if (!m_selectedUnreadIdx.isEmpty()) {
-            m_selectedUnreadIdx.clear();
+        if (!m_selectedUnreadIds.isEmpty()) {
+            m_selectedUnreadIds.clear();
             emit unreadMailsSelectedChanged();
         }
     }
@@ -610,6 +1443,21 @@ bool EmailMessageListModel::canFetchMore() const
     return m_canFetchMore;
 }
 
+bool EmailMessageListModel::canFetchMore(const QModelIndex &parent) const
+{
+    // Only rows held back by asynchronous population, an explicit limit is raised by the client
+    const uint populated = QMailMessageListModel::limit();
+    return !parent.isValid() && !m_limit && populated > 0 && !m_populating && !m_showingResults
+            && uint(rowCount()) >= populated;
+}
+
+void EmailMessageListModel::fetchMore(const QModelIndex &parent)
+{
+    if (canFetchMore(parent)) {
+        QMailMessageListModel::setLimit(QMailMessageListModel::limit() + FetchMorePageSize);
+    }
+}
+
 void EmailMessageListModel::useCombinedInbox()
 {
     if (m_combinedInbox) {
@@ -635,26 +1483,109 @@ void EmailMessageListModel::useCombinedInbox()
     QMailMessageKey unreadKey = QMailMessageKey::parentFolderId(inboxKey)
             & excludeReadKey
             & excludeRemovedKey;
-    QMailMessageListModel::setKey(unreadKey);
-    m_key = key();
+    m_key = unreadKey;
+    // Listed search results stay, the key applies from the next search on
+    if (!m_showingResults) {
+        QMailMessageListModel::setKey(unreadKey);
+    }
 
     m_combinedInbox = true;
 }
 
 uint EmailMessageListModel::limit() const
 {
-    return QMailMessageListModel::limit();
+    return m_limit;
 }
 
 void EmailMessageListModel::setLimit(uint limit)
 {
-    if (limit != this->limit()) {
-        QMailMessageListModel::setLimit(limit);
+    if (limit != m_limit) {
+        m_limit = limit;
+        // Ongoing population converges to the new limit by itself. Lifting the limit
+        // of an asynchronously populated list keeps the rows, the view fetches more.
+        if (!m_populating && (limit || !m_asyncPopulation)) {
+            QMailMessageListModel::setLimit(limit);
+        }
         emit limitChanged();
         checkFetchMoreChanged();
     }
 }
 
+bool EmailMessageListModel::asyncPopulation() const
+{
+    return m_asyncPopulation;
+}
+
+void EmailMessageListModel::setAsyncPopulation(bool value)
+{
+    if (value != m_asyncPopulation) {
+        m_asyncPopulation = value;
+        // Also drops the limit kept from the last population
+        if (!value && (m_populating || QMailMessageListModel::limit() != m_limit)) {
+            finishPopulation();
+        }
+        emit asyncPopulationChanged();
+    }
+}
+
+bool EmailMessageListModel::populating() const
+{
+    return m_populating;
+}
+
+void EmailMessageListModel::beginPopulation()
+{
+    const uint firstPage = m_limit ? qMin(m_limit, PopulationPageSize) : PopulationPageSize;
+    m_populationTimer.stop();
+    // Step the limit down on an empty list, otherwise the old key and sort key
+    // would be queried with it before the caller sets the new ones
+    QMailMessageListModel::setKey(QMailMessageKey::nonMatchingKey());
+    QMailMessageListModel::setLimit(firstPage);
+
+    if (!m_populating) {
+        m_populating = true;
+        emit populatingChanged();
+    }
+}
+
+void EmailMessageListModel::populateMore()
+{
+    const uint currentLimit = QMailMessageListModel::limit();
+
+    // Everything matching the key is already in
+    if (uint(rowCount()) < currentLimit) {
+        finishPopulation();
+        return;
+    }
+
+    const uint nextLimit = currentLimit * 2;
+    if (m_limit ? nextLimit >= m_limit : nextLimit > MaxPopulatedRows) {
+        finishPopulation();
+        return;
+    }
+
+    // Each step runs a single limited id query and appends the new rows,
+    // leaving the event loop free to render frames in between.
+    QMailMessageListModel::setLimit(nextLimit);
+    m_populationTimer.start();
+}
+
+void EmailMessageListModel::finishPopulation()
+{
+    m_populationTimer.stop();
+    // Without a limit the last step is kept, lifting it would list the whole folder
+    // in a single query. Further rows come through fetchMore().
+    if ((m_limit || !m_asyncPopulation) && QMailMessageListModel::limit() != m_limit) {
+        QMailMessageListModel::setLimit(m_limit);
+    }
+
+    if (m_populating) {
+        m_populating = false;
+        emit populatingChanged();
+    }
+    checkFetchMoreChanged();
+}
+
 uint EmailMessageListModel::searchLimit() const
 {
     return m_searchLimit;
@@ -738,6 +1669,24 @@ int EmailMessageListModel::searchRemainingOnRemote() const
     return m_searchRemainingOnRemote;
 }
 
+int EmailMessageListModel::searchRemainingOnRemoteForAccount(int accountId) const
+{
+    return m_searchRemainingByAccount.value(QMailAccountId(accountId));
+}
+
+QMailAccountIdList EmailMessageListModel::searchAccountIds() const
+{
+    if (m_combinedInbox) {
+        return m_mailAccountIds;
+    }
+
+    QMailAccountIdList accountIds;
+    if (m_folderAccessor->accountId().isValid()) {
+        accountIds.append(m_folderAccessor->accountId());
+    }
+    return accountIds;
+}
+
 void EmailMessageListModel::setSearchRemainingOnRemote(int count)
 {
     if (count != m_searchRemainingOnRemote) {
@@ -748,6 +1697,11 @@ void EmailMessageListModel::setSearchRemainingOnRemote(int count)
 
 void EmailMessageListModel::checkFetchMoreChanged()
 {
+    // Rows are still coming in, decided once population is done
+    if (m_populating) {
+        return;
+    }
+
     if (limit()) {
         bool canFetchMore = QMailMessageListModel::totalCount() > rowCount();
         if (canFetchMore != m_canFetchMore) {
@@ -762,20 +1716,105 @@ void EmailMessageListModel::checkFetchMoreChanged()
 
 void EmailMessageListModel::messagesAdded(const QMailMessageIdList &ids)
 {
-    Q_UNUSED(ids);
+    // New messages may match a search the previous results don't cover
+    m_lastResults.valid = false;
+    m_keyMessageCount = -1;
+
+    if (m_showingResults && !ids.isEmpty()) {
+        addResults(QMailStore::instance()->messagesMetaData(m_searchKey & QMailMessageKey::id(ids),
+                                                            MessageDataProperties));
+    }
 
     if (limit() > 0 && !m_canFetchMore) {
-        checkFetchMoreChanged();
+        scheduleFetchMoreCheck();
     }
 }
 
 void EmailMessageListModel::messagesRemoved(const QMailMessageIdList &ids)
 {
-    Q_UNUSED(ids);
+    m_keyMessageCount = -1;
+    invalidateMessageData(ids);
+    updateSelectedMessages(ids, true);
+    if (m_showingResults) {
+        removeResults(ids);
+    }
 
     if (limit() > 0 && m_canFetchMore) {
+        scheduleFetchMoreCheck();
+    }
+}
+
+void EmailMessageListModel::messagesUpdated(const QMailMessageIdList &ids)
+{
+    // Cached data is dropped right away so reads in between see the new state.
+    // The base model announces its own rows, changed results are collected
+    // and announced together.
+    invalidateMessageData(ids);
+    updateSelectedMessages(ids, false);
+    m_lastResults.valid = false;
+    // Messages may have moved in or out of the key
+    m_keyMessageCount = -1;
+    if (!m_showingResults) {
+        return;
+    }
+    updateResults(ids);
+
+    // The base model lists no results, so the views hear of their changes from here
+    for (const QMailMessageId &id : ids) {
+        if (rowFromId(id) >= 0) {
+            m_pendingUpdates.insert(id);
+            m_pendingNotifications++;
+        }
+    }
+
+    if (!m_pendingUpdates.isEmpty() && !m_notificationTimer.isActive()) {
+        m_notificationTimer.start();
+    }
+}
+
+void EmailMessageListModel::scheduleFetchMoreCheck()
+{
+    m_fetchMoreCheckPending = true;
+    m_pendingNotifications++;
+
+    if (!m_notificationTimer.isActive()) {
+        m_notificationTimer.start();
+    }
+}
+
+void EmailMessageListModel::flushNotifications()
+{
+    int emitted = 0;
+
+    // Changed results, one signal per contiguous range of rows
+    if (!m_pendingUpdates.isEmpty()) {
+        QBitArray rows(rowCount());
+        for (const QMailMessageId &id : m_pendingUpdates) {
+            int row = rowFromId(id);
+            if (row >= 0) {
+                rows.setBit(row);
+            }
+        }
+        m_pendingUpdates.clear();
+        emitted += emitRowsChanged(rows, QVector<int>());
+    }
+
+    if (m_fetchMoreCheckPending) {
+        m_fetchMoreCheckPending = false;
         checkFetchMoreChanged();
+        emitted++;
     }
+
+    if (m_pendingNotifications > emitted) {
+        m_coalescedNotifications += m_pendingNotifications - emitted;
+        emit coalescedNotificationsChanged();
+    }
+    m_pendingNotifications = 0;
+}
+
+int EmailMessageListModel::coalescedNotifications() const
+{
+    return m_coalescedNotifications;
 }
 
 void EmailMessageListModel::searchOnline()
@@ -784,7 +1823,9 @@ void EmailMessageListModel::searchOnline()
     // if changed we skip online search until local search returns again
     if (!m_searchCanceled && (m_remoteSearch == m_search)) {
         qCDebug(lcEmail) << "Starting remote search for" << m_search;
-        EmailAgent::instance()->searchMessages(m_searchKey, m_search, QMailSearchAction::Remote, m_searchLimit, m_searchBody);
+        EmailAgent::instance()->searchRemoteMessages(searchAccountIds(), m_searchKey, m_search,
+                                                     m_searchLimit, m_searchBody);
+        m_searchGeneration = EmailAgent::instance()->searchGeneration();
     }
 }
 
@@ -799,15 +1840,20 @@ void EmailMessageListModel::onSearchCompleted(const QString &search, const QMail
         qCDebug(lcEmail) << "Search terms are different, skipping. Received:" << search << "Have:" << m_search;
         return;
     }
+
+    // The final merge below covers everything streamed so far
+    resetMatchedIds();
     switch (status) {
     case EmailAgent::SearchDone:
         if (isRemote) {
             // Append online search results to local ones
-            setKey(key() | QMailMessageKey::id(matchedIds));
+            mergeResultIds(matchedIds);
             setSearchRemainingOnRemote(remainingMessagesOnRemote);
             qCDebug(lcEmail) << "We have more messages on remote, remaining count:" << remainingMessagesOnRemote;
         } else {
-            setKey(m_searchKey | QMailMessageKey::id(matchedIds));
+            mergeResultIds(matchedIds);
+            // Body matches beyond the limit are missing, a search refining these would miss them too
+            storeSearchResults(search, !m_searchBody || !m_searchLimit || uint(matchedIds.count()) < m_searchLimit);
             if ((m_searchOn == EmailMessageListModel::LocalAndRemote) && EmailAgent::instance()->isOnline() && !m_searchCanceled) {
                 m_remoteSearch = search;
                 // start online search after 2 seconds to avoid flooding the server with incomplete queries
@@ -826,6 +1872,60 @@ void EmailMessageListModel::onSearchCompleted(const QString &search, const QMail
     }
 }
 
+void EmailMessageListModel::onSearchAccountCompleted(const QString &search, const QMailAccountId &accountId,
+                                                     const QMailMessageIdList &matchedIds, int remainingMessagesOnRemote)
+{
+    if (m_search.isEmpty() || search != m_search) {
+        return;
+    }
+
+    // Each server's page is shown as soon as it is in, without waiting for the slower ones
+    mergeResultIds(matchedIds);
+    m_searchRemainingByAccount.insert(accountId, remainingMessagesOnRemote);
+
+    int remaining = 0;
+    for (int count : m_searchRemainingByAccount) {
+        remaining += count;
+    }
+    setSearchRemainingOnRemote(remaining);
+}
+
+void EmailMessageListModel::onSearchMessageIdsMatched(const QMailMessageIdList &ids)
+{
+    if (m_search.isEmpty() || m_searchCanceled || ids.isEmpty()) {
+        return;
+    }
+    // Matches of a search started by another model or superseded by a newer one
+    if (m_searchGeneration != EmailAgent::instance()->searchGeneration()) {
+        return;
+    }
+
+    // Batches arriving within a frame are shown together
+    m_pendingMatchedIds += ids;
+    if (!m_searchStreamTimer.isActive()) {
+        m_searchStreamTimer.start();
+    }
+}
+
+void EmailMessageListModel::appendMatchedIds()
+{
+    if (m_pendingMatchedIds.isEmpty() || m_search.isEmpty()) {
+        return;
+    }
+
+    // Show the matches while the search is still running
+    const QMailMessageIdList ids = m_pendingMatchedIds;
+    m_pendingMatchedIds.clear();
+    mergeResultIds(ids);
+    qCDebug(lcEmail) << "Showing" << m_resultIds.count() << "search matches so far";
+}
+
+void EmailMessageListModel::resetMatchedIds()
+{
+    m_searchStreamTimer.stop();
+    m_pendingMatchedIds.clear();
+}
+
 void EmailMessageListModel::accountsChanged()
 {
     if (!m_combinedInbox) {
@@ -15,6 +15,10 @@
 #include "folderaccessor.h"
 
 #include <QAbstractListModel>
+#include <QBitArray>
+#include <QCache>
+#include <QDateTime>
+#include <QSet>
 #include <QTimer>
 
 #include <qmailmessage.h>
@@ -44,6 +48,10 @@ class Q_DECL_EXPORT EmailMessageListModel : public QMailMessageListModel
     Q_PROPERTY(int searchRemainingOnRemote READ searchRemainingOnRemote NOTIFY searchRemainingOnRemoteChanged FINAL)
     Q_PROPERTY(EmailMessageListModel::Sort sortBy READ sortBy WRITE setSortBy NOTIFY sortByChanged)
     Q_PROPERTY(bool unreadMailsSelected READ unreadMailsSelected NOTIFY unreadMailsSelectedChanged FINAL)
+    Q_PROPERTY(int prefetchLookAhead READ prefetchLookAhead WRITE setPrefetchLookAhead NOTIFY prefetchLookAheadChanged FINAL)
+    Q_PROPERTY(bool asyncPopulation READ asyncPopulation WRITE setAsyncPopulation NOTIFY asyncPopulationChanged FINAL)
+    Q_PROPERTY(bool populating READ populating NOTIFY populatingChanged FINAL)
+    Q_PROPERTY(int coalescedNotifications READ coalescedNotifications NOTIFY coalescedNotificationsChanged FINAL)
 
 public:
     enum Roles {
@@ -85,12 +93,18 @@ public:
     ~EmailMessageListModel();
 
     int rowCount(const QModelIndex & parent = QModelIndex()) const;
+    QModelIndex index(int row, int column = 0, const QModelIndex &parent = QModelIndex()) const;
     QVariant data(const QModelIndex & index, int role = Qt::DisplayRole) const;
 
+    QMailMessageId idFromIndex(const QModelIndex &index) const;
+    QModelIndex indexFromId(const QMailMessageId &id) const;
+
     FolderAccessor *folderAccessor() const;
     void setFolderAccessor(FolderAccessor *accessor);
 
     bool canFetchMore() const;
+    virtual bool canFetchMore(const QModelIndex &parent) const;
+    virtual void fetchMore(const QModelIndex &parent);
     int count() const;
     int selectedMessageCount() const;
     uint limit() const;
@@ -111,6 +125,12 @@ public:
     void setSortBy(Sort sort);
     EmailMessageListModel::Sort sortBy() const;
     bool unreadMailsSelected() const;
+    int prefetchLookAhead() const;
+    void setPrefetchLookAhead(int rows);
+    bool asyncPopulation() const;
+    void setAsyncPopulation(bool value);
+    bool populating() const;
+    int coalescedNotifications() const;
 
 Q_SIGNALS:
     void folderAccessorChanged();
@@ -127,12 +147,18 @@ Q_SIGNALS:
     void searchRemainingOnRemoteChanged();
     void sortByChanged();
     void unreadMailsSelectedChanged();
+    void prefetchLookAheadChanged();
+    void asyncPopulationChanged();
+    void populatingChanged();
+    void coalescedNotificationsChanged();
 
 public:
     Q_INVOKABLE void setSearch(const QString &search);
     Q_INVOKABLE void cancelSearch();
+    Q_INVOKABLE int searchRemainingOnRemoteForAccount(int accountId) const;
 
     Q_INVOKABLE int indexFromMessageId(int messageId);
+    Q_INVOKABLE void prefetch(int firstRow, int lastRow);
 
     Q_INVOKABLE void selectAllMessages();
     Q_INVOKABLE void deselectAllMessages();
@@ -147,7 +173,18 @@ public:
 private slots:
     void messagesAdded(const QMailMessageIdList &ids);
     void messagesRemoved(const QMailMessageIdList &ids);
+    void messagesUpdated(const QMailMessageIdList &ids);
+    void onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+    void onRowsInserted(const QModelIndex &parent, int first, int last);
+    void onRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    void invalidateRowIndex();
+    void populateMore();
+    void flushNotifications();
     void searchOnline();
+    void onSearchAccountCompleted(const QString &search, const QMailAccountId &accountId,
+                                  const QMailMessageIdList &matchedIds, int remainingMessagesOnRemote);
+    void onSearchMessageIdsMatched(const QMailMessageIdList &ids);
+    void appendMatchedIds();
     void onSearchCompleted(const QString &search, const QMailMessageIdList &matchedIds, bool isRemote,
                            int remainingMessagesOnRemote, EmailAgent::SearchStatus status);
     void accountsChanged();
@@ -156,15 +193,86 @@ protected:
     virtual QHash<int, QByteArray> roleNames() const;
 
 private:
+    // Decoded metadata of a single message, shared by all roles of a row
+    struct MessageData {
+        quint64 status;
+        QMailAddress from;
+        QList<QMailAddress> recipients;
+        QDateTime date;
+        QString subject;
+        QString parsedSubject;
+        QString trimmedSubject;
+        QString preview;
+        uint size;
+        QMailFolderId folderId;
+        QMailAccountId accountId;
+        // Written to the metadata by MessageFieldWriter
+        bool fieldsWritten;
+        bool fieldsRequested;
+        QString toField;
+        QString ccField;
+        QString bccField;
+        QStringList attachments;
+        // Decoded on demand, only for the roles needing them
+        bool headersLoaded;
+        QStringList to;
+        QStringList cc;
+        QStringList bcc;
+    };
+
+    // Outcome of the last local search, used to narrow down the next one
+    struct SearchResults {
+        SearchResults() : from(false), recipients(false), subject(false), body(false), valid(false) {}
+
+        QString search;
+        QMailMessageKey folderKey;
+        bool from;
+        bool recipients;
+        bool subject;
+        bool body;
+        bool valid;
+        QMailMessageIdList ids;
+        // Messages received since are not in ids
+        QDateTime started;
+    };
+
+    MessageData *messageData(const QModelIndex &index) const;
+    MessageData *cacheMessageData(const QMailMessageMetaData &metaData) const;
+    void loadHeaders(const QMailMessageId &id, MessageData *item) const;
+    void requestFields(const QMailMessageId &id, MessageData *item) const;
+    void prefetchRows(int firstRow, int lastRow) const;
+    void dropRowData(int first, int last);
+    void invalidateMessageData(const QMailMessageIdList &ids);
+    int rowFromId(const QMailMessageId &id) const;
+    int emitRowsChanged(const QBitArray &rows, const QVector<int> &roles);
+    void scheduleFetchMoreCheck();
+    void updateSelectedMessages(const QMailMessageIdList &ids, bool removed);
+    bool listsAllMessages() const;
+    bool allMessagesSelected() const;
+    bool canRefineSearch(const QString &search) const;
+    void storeSearchResults(const QString &search, bool complete);
+    void resetMatchedIds();
+    void mergeResultIds(const QMailMessageIdList &ids);
+    void showResults(const QMailMessageIdList &rows);
+    void hideResults();
+    void addResults(const QMailMessageMetaDataList &metaDataList);
+    void removeResults(const QMailMessageIdList &ids);
+    void updateResults(const QMailMessageIdList &ids);
+    void sortResults();
+    int resultPosition(const MessageData &item) const;
+    bool lessThan(const MessageData &left, const MessageData &right) const;
+    void beginPopulation();
+    void finishPopulation();
     void useCombinedInbox();
     void sortByOrder(Qt::SortOrder order, EmailMessageListModel::Sort sortBy);
     void checkFetchMoreChanged();
+    QMailAccountIdList searchAccountIds() const;
     void setSearchRemainingOnRemote(int count);
 
     QHash<int, QByteArray> roles;
     bool m_combinedInbox;
     bool m_canFetchMore;
-    int m_limit;
+    uint m_limit;
     QMailAccountIdList m_mailAccountIds;
     QString m_search;
     QString m_remoteSearch;
@@ -176,15 +284,43 @@ private:
     bool m_searchSubject;
     bool m_searchBody;
     int m_searchRemainingOnRemote;
+    QHash<QMailAccountId, int> m_searchRemainingByAccount;
     bool m_searchCanceled;
+    // Generation of the agent search started by this model
+    quint64 m_searchGeneration;
     QMailMessageKey m_searchKey;
+    QDateTime m_searchStarted;
+    SearchResults m_lastResults;
+    // While searching the rows are the results, listed by this model rather than by a key
+    bool m_showingResults;
+    QMailMessageIdList m_resultRows;
+    // The same results sorted by id
+    QMailMessageIdList m_resultIds;
+    QMailMessageIdList m_pendingMatchedIds;
+    QTimer m_searchStreamTimer;
     QMailMessageKey m_key;
     QMailMessageSortKey m_sortKey;
     EmailMessageListModel::Sort m_sortBy;
-    QMap<int, QMailMessageId> m_selectedMsgIds;
-    QList<int> m_selectedUnreadIdx;
+    Qt::SortOrder m_sortOrder;
+    QSet<QMailMessageId> m_selectedMsgIds;
+    QSet<QMailMessageId> m_selectedUnreadIds;
     QTimer m_remoteSearchTimer;
     FolderAccessor *m_folderAccessor;
+    mutable QCache<QMailMessageId, MessageData> m_messageCache;
+    int m_prefetchLookAhead;
+    mutable QHash<QMailMessageId, int> m_rowIndex;
+    mutable bool m_rowIndexValid;
+    bool m_asyncPopulation;
+    bool m_populating;
+    QTimer m_populationTimer;
+    QSet<QMailMessageId> m_pendingUpdates;
+    bool m_fetchMoreCheckPending;
+    int m_pendingNotifications;
+    int m_coalescedNotifications;
+    // Messages matching m_countedKey in the store, -1 once the store has changed
+    mutable QMailMessageKey m_countedKey;
+    mutable int m_keyMessageCount;
+    QTimer m_notificationTimer;
 };
 
 #endif
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <algorithm>
+
+#include <QElapsedTimer>
+
+#include <qmailstore.h>
+
+#include "headersearchindex.h"
+#include "logging_p.h"
+
+namespace {
+
+const int TrigramLength = 3;
+
+// Messages loaded per store query while indexing an account, and the milliseconds
+// spent loading per timer round and between the rounds
+const int LoadBatchSize = 200;
+const int LoadBudget = 5;
+const int LoadInterval = 50;
+
+const QMailMessageKey::Properties EntryProperties(QMailMessageKey::Id
+                                                  | QMailMessageKey::ParentAccountId
+                                                  | QMailMessageKey::Sender
+                                                  | QMailMessageKey::Recipients
+                                                  | QMailMessageKey::Subject);
+
+quint64 trigramAt(const QString &text, int position)
+{
+    return (quint64(text.at(position).unicode()) << 32)
+            | (quint64(text.at(position + 1).unicode()) << 16)
+            | quint64(text.at(position + 2).unicode());
+}
+
+void addTrigrams(const QString &text, QSet<quint64> *trigrams)
+{
+    for (int i = 0; i + TrigramLength <= text.length(); i++) {
+        trigrams->insert(trigramAt(text, i));
+    }
+}
+
+}
+
+HeaderSearchIndex::HeaderSearchIndex(QObject *parent)
+    : QObject(parent)
+{
+    m_loadTimer.setInterval(LoadInterval);
+    connect(&m_loadTimer, SIGNAL(timeout()), this, SLOT(loadPending()));
+
+    connect(QMailStore::instance(), SIGNAL(accountsRemoved(QMailAccountIdList)),
+            this, SLOT(accountsRemoved(QMailAccountIdList)));
+    connect(QMailStore::instance(), SIGNAL(messagesAdded(QMailMessageIdList)),
+            this, SLOT(messagesAdded(QMailMessageIdList)));
+    connect(QMailStore::instance(), SIGNAL(messagesUpdated(QMailMessageIdList)),
+            this, SLOT(messagesUpdated(QMailMessageIdList)));
+    connect(QMailStore::instance(), SIGNAL(messagesRemoved(QMailMessageIdList)),
+            this, SLOT(messagesRemoved(QMailMessageIdList)));
+}
+
+HeaderSearchIndex::~HeaderSearchIndex()
+{
+}
+
+bool HeaderSearchIndex::search(const QString &text, Fields fields, const QMailAccountIdList &accountIds,
+                               QMailMessageIdList *result)
+{
+    const QString needle = text.toLower();
+    if (needle.length() < TrigramLength || !fields) {
+        return false;
+    }
+
+    // Typing goes on with the store keys until the accounts are indexed
+    const QMailAccountIdList scope = accountIds.isEmpty() ? QMailStore::instance()->queryAccounts() : accountIds;
+    if (!isIndexed(scope)) {
+        startIndexing(scope);
+        return false;
+    }
+
+    result->clear();
+
+    const QVector<quint64> *candidates = 0;
+    for (int i = 0; i + TrigramLength <= needle.length(); i++) {
+        QHash<quint64, QVector<quint64> >::const_iterator it = m_postings.constFind(trigramAt(needle, i));
+        if (it == m_postings.constEnd()) {
+            return true;
+        }
+        if (!candidates || it.value().count() < candidates->count()) {
+            candidates = &it.value();
+        }
+    }
+
+    // Messages of other indexed accounts are left to the caller's folder key
+    for (quint64 id : *candidates) {
+        const Entry &entry = m_entries.constFind(id).value();
+        if (((fields & Sender) && entry.sender.contains(needle))
+                || ((fields & Recipients) && entry.recipients.contains(needle))
+                || ((fields & Subject) && entry.subject.contains(needle))) {
+            result->append(QMailMessageId(id));
+        }
+    }
+    return true;
+}
+
+bool HeaderSearchIndex::isIndexed(const QMailAccountIdList &accountIds) const
+{
+    for (const QMailAccountId &accountId : accountIds) {
+        if (!m_indexedAccounts.contains(accountId)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int HeaderSearchIndex::count() const
+{
+    return m_entries.count();
+}
+
+HeaderSearchIndex::Entry HeaderSearchIndex::entryFor(const QMailMessageMetaData &metaData)
+{
+    Entry entry;
+    entry.sender = metaData.from().toString().toLower();
+    entry.recipients = QMailAddress::toStringList(metaData.recipients()).join(QStringLiteral(", ")).toLower();
+    entry.subject = metaData.subject().toLower();
+    return entry;
+}
+
+void HeaderSearchIndex::startIndexing(const QMailAccountIdList &accountIds)
+{
+    for (const QMailAccountId &accountId : accountIds) {
+        if (m_indexedAccounts.contains(accountId) || m_pending.contains(accountId)) {
+            continue;
+        }
+        // Only the ids now, the fields are loaded in batches from the event loop
+        m_pending.insert(accountId, QMailStore::instance()->queryMessages(QMailMessageKey::parentAccountId(accountId),
+                                                                          QMailMessageSortKey::id()));
+    }
+
+    if (!m_pending.isEmpty() && !m_loadTimer.isActive()) {
+        m_loadTimer.start();
+    }
+}
+
+void HeaderSearchIndex::loadPending()
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+    while (!m_pending.isEmpty() && elapsed.elapsed() < LoadBudget) {
+        QHash<QMailAccountId, QMailMessageIdList>::iterator it = m_pending.begin();
+        const QMailMessageIdList batch = it.value().mid(0, LoadBatchSize);
+        if (!batch.isEmpty()) {
+            it.value().erase(it.value().begin(), it.value().begin() + batch.count());
+            update(batch);
+        }
+        if (it.value().isEmpty()) {
+            m_indexedAccounts.insert(it.key());
+            m_pending.erase(it);
+        }
+    }
+
+    if (m_pending.isEmpty()) {
+        m_loadTimer.stop();
+        qCDebug(lcEmail) << "Header search index has" << m_entries.count() << "messages,"
+                         << m_postings.count() << "trigrams";
+    }
+}
+
+void HeaderSearchIndex::update(const QMailMessageIdList &ids)
+{
+    const QMailMessageMetaDataList metaDataList
+            = QMailStore::instance()->messagesMetaData(QMailMessageKey::id(ids), EntryProperties);
+    for (const QMailMessageMetaData &metaData : metaDataList) {
+        const quint64 id = metaData.id().toULongLong();
+        const QMailAccountId accountId = metaData.parentAccountId();
+        if (!m_indexedAccounts.contains(accountId) && !m_pending.contains(accountId)) {
+            // Moved to an account not indexed
+            remove(id);
+            continue;
+        }
+        const Entry entry = entryFor(metaData);
+
+        // Most updates are flag changes leaving the fields untouched
+        QHash<quint64, Entry>::const_iterator it = m_entries.constFind(id);
+        if (it != m_entries.constEnd() && it.value().sender == entry.sender
+                && it.value().recipients == entry.recipients && it.value().subject == entry.subject) {
+            continue;
+        }
+        remove(id);
+        insert(id, entry);
+    }
+}
+
+void HeaderSearchIndex::insert(quint64 id, const Entry &entry)
+{
+    QSet<quint64> trigrams;
+    addTrigrams(entry.sender, &trigrams);
+    addTrigrams(entry.recipients, &trigrams);
+    addTrigrams(entry.subject, &trigrams);
+    for (quint64 trigram : trigrams) {
+        QVector<quint64> &ids = m_postings[trigram];
+        // Messages mostly come in id order, appending keeps the posting sorted
+        if (ids.isEmpty() || ids.last() < id) {
+            ids.append(id);
+        } else {
+            QVector<quint64>::iterator position = std::lower_bound(ids.begin(), ids.end(), id);
+            if (*position != id) {
+                ids.insert(position, id);
+            }
+        }
+    }
+    m_entries.insert(id, entry);
+}
+
+void HeaderSearchIndex::remove(quint64 id)
+{
+    QHash<quint64, Entry>::iterator it = m_entries.find(id);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    QSet<quint64> trigrams;
+    addTrigrams(it.value().sender, &trigrams);
+    addTrigrams(it.value().recipients, &trigrams);
+    addTrigrams(it.value().subject, &trigrams);
+    for (quint64 trigram : trigrams) {
+        QHash<quint64, QVector<quint64> >::iterator posting = m_postings.find(trigram);
+        if (posting == m_postings.end()) {
+            continue;
+        }
+        QVector<quint64> &ids = posting.value();
+        QVector<quint64>::iterator position = std::lower_bound(ids.begin(), ids.end(), id);
+        if (position != ids.end() && *position == id) {
+            ids.erase(position);
+        }
+        if (ids.isEmpty()) {
+            m_postings.erase(posting);
+        }
+    }
+    m_entries.erase(it);
+}
+
+void HeaderSearchIndex::accountsRemoved(const QMailAccountIdList &ids)
+{
+    // The messages of the accounts are removed through messagesRemoved()
+    for (const QMailAccountId &id : ids) {
+        m_indexedAccounts.remove(id);
+        m_pending.remove(id);
+    }
+}
+
+void HeaderSearchIndex::messagesAdded(const QMailMessageIdList &ids)
+{
+    if (!m_indexedAccounts.isEmpty() || !m_pending.isEmpty()) {
+        update(ids);
+    }
+}
+
+void HeaderSearchIndex::messagesUpdated(const QMailMessageIdList &ids)
+{
+    if (!m_indexedAccounts.isEmpty() || !m_pending.isEmpty()) {
+        update(ids);
+    }
+}
+
+void HeaderSearchIndex::messagesRemoved(const QMailMessageIdList &ids)
+{
+    for (const QMailMessageId &id : ids) {
+        remove(id.toULongLong());
+    }
+}
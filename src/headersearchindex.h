@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef HEADERSEARCHINDEX_H
+#define HEADERSEARCHINDEX_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
+
+#include <qmailaccount.h>
+#include <qmailmessage.h>
+
+// In-memory trigram index over the sender, recipients and subject of the messages.
+// Substring lookups take the candidates of the rarest trigram of the text and verify
+// them against the fields, giving the same matches as an Includes key without scanning
+// the store. Accounts are indexed when they are first searched, a batch of messages
+// at a time from the event loop, after which the index follows the store signals.
+class HeaderSearchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Field {
+        Sender = 0x1,
+        Recipients = 0x2,
+        Subject = 0x4
+    };
+    Q_DECLARE_FLAGS(Fields, Field)
+
+    explicit HeaderSearchIndex(QObject *parent = 0);
+    ~HeaderSearchIndex();
+
+    // Messages of the accounts with any of the fields containing text, case insensitively.
+    // An empty account list stands for all accounts. Returns false if text is shorter than
+    // a trigram or if some of the accounts are still being indexed, the first search of an
+    // account starts indexing it.
+    bool search(const QString &text, Fields fields, const QMailAccountIdList &accountIds,
+                QMailMessageIdList *result);
+    bool isIndexed(const QMailAccountIdList &accountIds) const;
+    int count() const;
+
+private slots:
+    void accountsRemoved(const QMailAccountIdList &ids);
+    void messagesAdded(const QMailMessageIdList &ids);
+    void messagesUpdated(const QMailMessageIdList &ids);
+    void messagesRemoved(const QMailMessageIdList &ids);
+    void loadPending();
+
+private:
+    struct Entry {
+        QString sender;
+        QString recipients;
+        QString subject;
+    };
+
+    static Entry entryFor(const QMailMessageMetaData &metaData);
+    void startIndexing(const QMailAccountIdList &accountIds);
+    void update(const QMailMessageIdList &ids);
+    void insert(quint64 id, const Entry &entry);
+    void remove(quint64 id);
+
+    QHash<quint64, Entry> m_entries;
+    // Trigram to the sorted ids of the messages having it in any field
+    QHash<quint64, QVector<quint64> > m_postings;
+    QSet<QMailAccountId> m_indexedAccounts;
+    // Messages of the accounts being indexed still to be loaded
+    QHash<QMailAccountId, QMailMessageIdList> m_pending;
+    QTimer m_loadTimer;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(HeaderSearchIndex::Fields)
+
+#endif
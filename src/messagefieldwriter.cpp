@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <QElapsedTimer>
+
+#include <qmailstore.h>
+
+#include "messagefieldwriter.h"
+#include "logging_p.h"
+
+namespace {
+
+// Bumped when the way the fields are derived changes, the messages are written again
+const QString FieldsVersion = QStringLiteral("1");
+
+const QString VersionField = QStringLiteral("nemo-email-fields");
+const QString ToField = QStringLiteral("nemo-email-to");
+const QString CcField = QStringLiteral("nemo-email-cc");
+const QString BccField = QStringLiteral("nemo-email-bcc");
+const QString AttachmentsField = QStringLiteral("nemo-email-attachments");
+
+const QLatin1String AddressSeparator(", ");
+const QLatin1Char NameSeparator('\n');
+
+// Milliseconds spent per timer round and between the rounds
+const int WriteBudget = 5;
+const int WriteInterval = 50;
+
+QString fieldName(MessageFieldWriter::AddressField field)
+{
+    switch (field) {
+    case MessageFieldWriter::Cc:
+        return CcField;
+    case MessageFieldWriter::Bcc:
+        return BccField;
+    default:
+        return ToField;
+    }
+}
+
+bool setField(QMailMessage *message, const QString &name, const QString &value)
+{
+    if (message->customField(name) == value) {
+        return false;
+    }
+    message->setCustomField(name, value);
+    return true;
+}
+
+}
+
+MessageFieldWriter::MessageFieldWriter(QObject *parent)
+    : QObject(parent)
+{
+    m_writeTimer.setInterval(WriteInterval);
+    connect(&m_writeTimer, SIGNAL(timeout()), this, SLOT(writePending()));
+
+    connect(QMailStore::instance(), SIGNAL(messagesAdded(QMailMessageIdList)),
+            this, SLOT(messagesAdded(QMailMessageIdList)));
+    connect(QMailStore::instance(), SIGNAL(messageContentsModified(QMailMessageIdList)),
+            this, SLOT(messageContentsModified(QMailMessageIdList)));
+}
+
+MessageFieldWriter::~MessageFieldWriter()
+{
+}
+
+void MessageFieldWriter::request(const QMailMessageIdList &ids)
+{
+    enqueue(ids, true);
+}
+
+bool MessageFieldWriter::hasFields(const QMailMessageMetaData &metaData)
+{
+    return metaData.customField(VersionField) == FieldsVersion;
+}
+
+QString MessageFieldWriter::addressField(const QMailMessageMetaData &metaData, AddressField field)
+{
+    return metaData.customField(fieldName(field));
+}
+
+QStringList MessageFieldWriter::attachmentNames(const QMailMessageMetaData &metaData)
+{
+    const QString names = metaData.customField(AttachmentsField);
+    return names.isEmpty() ? QStringList() : names.split(NameSeparator);
+}
+
+QStringList MessageFieldWriter::addresses(const QString &field)
+{
+    return field.isEmpty() ? QStringList() : QMailAddress::toStringList(QMailAddress::fromStringList(field));
+}
+
+void MessageFieldWriter::messagesAdded(const QMailMessageIdList &ids)
+{
+    enqueue(ids, false);
+}
+
+void MessageFieldWriter::messageContentsModified(const QMailMessageIdList &ids)
+{
+    // Retrieved content can complete the headers and the part structure
+    enqueue(ids, false);
+}
+
+void MessageFieldWriter::writePending()
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    QList<QMailMessage> messages;
+    while (!m_pending.isEmpty() && elapsed.elapsed() < WriteBudget) {
+        const QMailMessageId id = m_pending.takeFirst();
+        m_pendingIds.remove(id);
+
+        QMailMessage message(id);
+        if (message.id().isValid() && setFields(&message)) {
+            messages.append(message);
+        }
+    }
+
+    if (!messages.isEmpty()) {
+        // Only the custom fields are modified, the rest of the metadata is left as stored
+        QList<QMailMessageMetaData *> metaDataList;
+        for (QMailMessage &message : messages) {
+            metaDataList.append(&message);
+        }
+        if (!QMailStore::instance()->updateMessages(metaDataList)) {
+            qCWarning(lcEmail) << "Cannot write the fields of" << messages.count() << "messages";
+        }
+    }
+
+    if (m_pending.isEmpty()) {
+        m_writeTimer.stop();
+    }
+}
+
+void MessageFieldWriter::enqueue(const QMailMessageIdList &ids, bool first)
+{
+    int position = 0;
+    for (const QMailMessageId &id : ids) {
+        if (first) {
+            // Moved ahead if already waiting
+            if (m_pendingIds.contains(id)) {
+                m_pending.removeOne(id);
+            }
+            m_pending.insert(position++, id);
+            m_pendingIds.insert(id);
+        } else if (!m_pendingIds.contains(id)) {
+            m_pendingIds.insert(id);
+            m_pending.append(id);
+        }
+    }
+
+    if (!m_pending.isEmpty() && !m_writeTimer.isActive()) {
+        m_writeTimer.start();
+    }
+}
+
+bool MessageFieldWriter::setFields(QMailMessage *message)
+{
+    QStringList names;
+    for (const QMailMessagePart::Location &location : message->findAttachmentLocations()) {
+        names << message->partAt(location).displayName();
+    }
+
+    bool modified = setField(message, ToField, QMailAddress::toStringList(message->to()).join(AddressSeparator));
+    modified |= setField(message, CcField, QMailAddress::toStringList(message->cc()).join(AddressSeparator));
+    modified |= setField(message, BccField, QMailAddress::toStringList(message->bcc()).join(AddressSeparator));
+    modified |= setField(message, AttachmentsField, names.join(NameSeparator));
+    modified |= setField(message, VersionField, FieldsVersion);
+    return modified;
+}
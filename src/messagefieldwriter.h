@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef MESSAGEFIELDWRITER_H
+#define MESSAGEFIELDWRITER_H
+
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+
+#include <qmailmessage.h>
+
+// Keeps the To, Cc and Bcc addresses and the attachment names of each message in
+// custom fields of its metadata, so that they are read along with the rest of the
+// metadata instead of loading the message with its bodies. Messages are written as
+// they are added or their content changes, the ones stored before on request, a
+// little at a time from the event loop.
+class MessageFieldWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum AddressField {
+        To,
+        Cc,
+        Bcc
+    };
+
+    explicit MessageFieldWriter(QObject *parent = 0);
+    ~MessageFieldWriter();
+
+    // Written ahead of the others, for rows a view is showing
+    void request(const QMailMessageIdList &ids);
+
+    // The metadata needs to be loaded with QMailMessageKey::Custom
+    static bool hasFields(const QMailMessageMetaData &metaData);
+    static QString addressField(const QMailMessageMetaData &metaData, AddressField field);
+    static QStringList attachmentNames(const QMailMessageMetaData &metaData);
+    // Decodes the value of an address field
+    static QStringList addresses(const QString &field);
+
+private slots:
+    void messagesAdded(const QMailMessageIdList &ids);
+    void messageContentsModified(const QMailMessageIdList &ids);
+    void writePending();
+
+private:
+    void enqueue(const QMailMessageIdList &ids, bool first);
+    static bool setFields(QMailMessage *message);
+
+    QList<QMailMessageId> m_pending;
+    QSet<QMailMessageId> m_pendingIds;
+    QTimer m_writeTimer;
+};
+
+#endif
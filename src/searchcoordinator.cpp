@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <QDataStream>
+#include <QSet>
+#include <qmailstore.h>
+
+#include "searchcoordinator.h"
+#include "logging_p.h"
+
+namespace {
+
+const int DefaultMaximumConcurrent = 3;
+const int DefaultCacheTimeToLive = 300;
+const int CacheSize = 64;
+
+}
+
+SearchCoordinator::SearchCoordinator(QObject *parent)
+    : QObject(parent),
+      m_limit(0),
+      m_searchBody(false),
+      m_maximumConcurrent(DefaultMaximumConcurrent),
+      m_generation(0),
+      m_cache(CacheSize),
+      m_cacheTimeToLive(DefaultCacheTimeToLive)
+{
+    connect(QMailStore::instance(), SIGNAL(foldersAdded(QMailFolderIdList)),
+            this, SLOT(foldersChanged(QMailFolderIdList)));
+    connect(QMailStore::instance(), SIGNAL(foldersUpdated(QMailFolderIdList)),
+            this, SLOT(foldersChanged(QMailFolderIdList)));
+    connect(QMailStore::instance(), SIGNAL(foldersRemoved(QMailFolderIdList)),
+            this, SLOT(foldersRemoved(QMailFolderIdList)));
+}
+
+SearchCoordinator::~SearchCoordinator()
+{
+    cancel();
+}
+
+int SearchCoordinator::maximumConcurrent() const
+{
+    return m_maximumConcurrent;
+}
+
+void SearchCoordinator::setMaximumConcurrent(int count)
+{
+    m_maximumConcurrent = qMax(1, count);
+    startPending();
+}
+
+int SearchCoordinator::cacheTimeToLive() const
+{
+    return m_cacheTimeToLive;
+}
+
+void SearchCoordinator::setCacheTimeToLive(int seconds)
+{
+    m_cacheTimeToLive = qMax(0, seconds);
+    if (m_cacheTimeToLive == 0) {
+        clearCache();
+    }
+}
+
+void SearchCoordinator::clearCache()
+{
+    m_cache.clear();
+}
+
+void SearchCoordinator::search(const QMailAccountIdList &accountIds, const QMailMessageKey &filter,
+                               const QString &text, quint64 limit, bool searchBody,
+                               const QMailMessageSortKey &sort)
+{
+    cancel();
+
+    m_filter = filter;
+    m_text = text;
+    m_limit = limit;
+    m_searchBody = searchBody;
+    m_sort = sort;
+
+    int cachedCount = 0;
+    for (const QMailAccountId &accountId : accountIds) {
+        AccountSearch *accountSearch = new AccountSearch;
+        accountSearch->accountId = accountId;
+        accountSearch->cacheKey = cacheKey(accountId);
+        m_searches.append(accountSearch);
+
+        if (m_cacheTimeToLive == 0) {
+            continue;
+        }
+        if (CachedResult *cached = m_cache.object(accountSearch->cacheKey)) {
+            if (cached->age.hasExpired(qint64(m_cacheTimeToLive) * 1000)) {
+                m_cache.remove(accountSearch->cacheKey);
+            } else {
+                accountSearch->cached = true;
+                accountSearch->matchedIds = cached->matchedIds;
+                accountSearch->remaining = cached->remaining;
+                cachedCount++;
+            }
+        }
+    }
+
+    qCDebug(lcEmail) << "Searching" << text << "on" << accountIds.count() << "accounts," << cachedCount << "cached";
+    if (cachedCount > 0) {
+        // Keep the results asynchronous like the ones from the server
+        QMetaObject::invokeMethod(this, "deliverCached", Qt::QueuedConnection);
+    }
+    startPending();
+}
+
+void SearchCoordinator::cancel()
+{
+    for (AccountSearch *accountSearch : m_searches) {
+        if (QMailSearchAction *action = accountSearch->action) {
+            disconnect(action, 0, this, 0);
+            if (action->isRunning()) {
+                action->cancelOperation();
+            }
+            action->deleteLater();
+        }
+    }
+    qDeleteAll(m_searches);
+    m_searches.clear();
+    m_matchedIds.clear();
+    m_generation++;
+}
+
+bool SearchCoordinator::isActive() const
+{
+    for (const AccountSearch *accountSearch : m_searches) {
+        if (!accountSearch->finished) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int SearchCoordinator::remainingCount(const QMailAccountId &accountId) const
+{
+    for (const AccountSearch *accountSearch : m_searches) {
+        if (accountSearch->accountId == accountId) {
+            return accountSearch->remaining;
+        }
+    }
+    return 0;
+}
+
+void SearchCoordinator::activityChanged(QMailServiceAction::Activity activity)
+{
+    if (activity != QMailServiceAction::Successful && activity != QMailServiceAction::Failed) {
+        return;
+    }
+
+    for (AccountSearch *accountSearch : m_searches) {
+        if (accountSearch->action == sender()) {
+            finish(accountSearch, activity == QMailServiceAction::Successful);
+            return;
+        }
+    }
+}
+
+void SearchCoordinator::deliverCached()
+{
+    const quint64 generation = m_generation;
+    for (int i = 0; i < m_searches.count(); i++) {
+        AccountSearch *accountSearch = m_searches.at(i);
+        if (accountSearch->cached && !accountSearch->finished) {
+            emit messageIdsMatched(accountSearch->matchedIds);
+            // A receiver may have started another search, deleting this one
+            if (generation != m_generation) {
+                return;
+            }
+            finish(accountSearch, true);
+            if (generation != m_generation) {
+                return;
+            }
+        }
+    }
+}
+
+void SearchCoordinator::foldersChanged(const QMailFolderIdList &ids)
+{
+    if (m_cache.isEmpty()) {
+        return;
+    }
+
+    // Server side changes show up as folder updates after a sync
+    QSet<QMailAccountId> accountIds;
+    for (const QMailFolderId &id : ids) {
+        accountIds.insert(QMailStore::instance()->folder(id).parentAccountId());
+    }
+    for (const QByteArray &key : m_cache.keys()) {
+        if (accountIds.contains(m_cache.object(key)->accountId)) {
+            m_cache.remove(key);
+        }
+    }
+}
+
+void SearchCoordinator::foldersRemoved(const QMailFolderIdList &ids)
+{
+    Q_UNUSED(ids)
+    // The owning accounts cannot be looked up anymore
+    clearCache();
+}
+
+QByteArray SearchCoordinator::cacheKey(const QMailAccountId &accountId) const
+{
+    QByteArray key;
+    QDataStream stream(&key, QIODevice::WriteOnly);
+    stream << accountId.toULongLong() << m_text.simplified().toLower() << m_searchBody << m_limit;
+    // The filter carries the folder and the searched fields
+    m_filter.serialize(stream);
+    m_sort.serialize(stream);
+    return key;
+}
+
+void SearchCoordinator::startPending()
+{
+    int running = 0;
+    for (const AccountSearch *accountSearch : m_searches) {
+        if (accountSearch->action) {
+            running++;
+        }
+    }
+
+    for (AccountSearch *accountSearch : m_searches) {
+        if (running >= m_maximumConcurrent) {
+            break;
+        }
+        if (accountSearch->action || accountSearch->cached || accountSearch->finished) {
+            continue;
+        }
+
+        QMailSearchAction *action = new QMailSearchAction(this);
+        connect(action, SIGNAL(activityChanged(QMailServiceAction::Activity)),
+                this, SLOT(activityChanged(QMailServiceAction::Activity)));
+        connect(action, SIGNAL(messageIdsMatched(const QMailMessageIdList&)),
+                this, SIGNAL(messageIdsMatched(const QMailMessageIdList&)));
+        accountSearch->action = action;
+        running++;
+
+        action->searchMessages(m_filter & QMailMessageKey::parentAccountId(accountSearch->accountId),
+                               m_searchBody ? m_text : QString(), QMailSearchAction::Remote, m_limit, m_sort);
+    }
+}
+
+void SearchCoordinator::finish(AccountSearch *accountSearch, bool success)
+{
+    if (QMailSearchAction *action = accountSearch->action) {
+        if (success) {
+            accountSearch->matchedIds = action->matchingMessageIds();
+            accountSearch->remaining = action->remainingMessagesCount();
+
+            if (m_cacheTimeToLive > 0) {
+                CachedResult *cached = new CachedResult;
+                cached->accountId = accountSearch->accountId;
+                cached->matchedIds = accountSearch->matchedIds;
+                cached->remaining = accountSearch->remaining;
+                cached->age.start();
+                m_cache.insert(accountSearch->cacheKey, cached);
+            }
+        } else {
+            qCWarning(lcEmail) << "Remote search failed for account" << accountSearch->accountId
+                               << "error:" << action->status().text;
+        }
+
+        accountSearch->action = 0;
+        disconnect(action, 0, this, 0);
+        action->deleteLater();
+    }
+
+    accountSearch->finished = true;
+    accountSearch->succeeded = success;
+
+    m_matchedIds += accountSearch->matchedIds;
+    const quint64 generation = m_generation;
+    emit accountSearchCompleted(m_text, accountSearch->accountId, accountSearch->matchedIds, accountSearch->remaining);
+
+    // A receiver may have started another search, deleting this one
+    if (generation != m_generation) {
+        return;
+    }
+
+    startPending();
+
+    if (!isActive()) {
+        int remaining = 0;
+        bool succeeded = false;
+        for (const AccountSearch *finished : m_searches) {
+            remaining += finished->remaining;
+            succeeded = succeeded || finished->succeeded;
+        }
+        emit searchCompleted(m_text, m_matchedIds, remaining, succeeded);
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef SEARCHCOORDINATOR_H
+#define SEARCHCOORDINATOR_H
+
+#include <QCache>
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+
+#include <qmailaccount.h>
+#include <qmailmessagekey.h>
+#include <qmailmessagesortkey.h>
+#include <qmailserviceaction.h>
+
+// Runs a remote search on several accounts at once, one QMailSearchAction per account
+// and at most maximumConcurrent() of them at a time. Matches are reported as they
+// arrive and per account, the whole search completes once every account is done.
+// Results of each account are cached for a while, so repeating a search is served
+// without asking the server again.
+class SearchCoordinator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SearchCoordinator(QObject *parent = 0);
+    ~SearchCoordinator();
+
+    int maximumConcurrent() const;
+    void setMaximumConcurrent(int count);
+    // Seconds a cached result is used, zero disables the cache
+    int cacheTimeToLive() const;
+    void setCacheTimeToLive(int seconds);
+    void clearCache();
+
+    // Cancels a search still running and starts the new one
+    void search(const QMailAccountIdList &accountIds, const QMailMessageKey &filter, const QString &text,
+                quint64 limit, bool searchBody, const QMailMessageSortKey &sort);
+    void cancel();
+    bool isActive() const;
+    int remainingCount(const QMailAccountId &accountId) const;
+
+signals:
+    void messageIdsMatched(const QMailMessageIdList &ids);
+    void accountSearchCompleted(const QString &text, const QMailAccountId &accountId,
+                                const QMailMessageIdList &matchedIds, int remainingOnRemote);
+    void searchCompleted(const QString &text, const QMailMessageIdList &matchedIds, int remainingOnRemote, bool success);
+
+private slots:
+    void activityChanged(QMailServiceAction::Activity activity);
+    void deliverCached();
+    void foldersChanged(const QMailFolderIdList &ids);
+    void foldersRemoved(const QMailFolderIdList &ids);
+
+private:
+    struct AccountSearch {
+        AccountSearch() : action(0), cached(false), finished(false), succeeded(false), remaining(0) {}
+
+        QMailAccountId accountId;
+        QByteArray cacheKey;
+        QMailSearchAction *action;
+        bool cached;
+        bool finished;
+        bool succeeded;
+        int remaining;
+        QMailMessageIdList matchedIds;
+    };
+
+    struct CachedResult {
+        QMailAccountId accountId;
+        QMailMessageIdList matchedIds;
+        int remaining;
+        QElapsedTimer age;
+    };
+
+    QByteArray cacheKey(const QMailAccountId &accountId) const;
+    void startPending();
+    void finish(AccountSearch *accountSearch, bool success);
+
+    QList<AccountSearch *> m_searches;
+    QMailMessageKey m_filter;
+    QString m_text;
+    quint64 m_limit;
+    bool m_searchBody;
+    QMailMessageSortKey m_sort;
+    int m_maximumConcurrent;
+    QMailMessageIdList m_matchedIds;
+    // Changes whenever the searches are dropped, receivers of the signals may start a new search
+    quint64 m_generation;
+    QCache<QByteArray, CachedResult> m_cache;
+    int m_cacheTimeToLive;
+};
+
+#endif
@@ -5,14 +5,21 @@ TARGET = nemoemail-qt5
 PKGCONFIG += QmfMessageServer QmfClient accounts-qt5
 
 SOURCES += \
+    $$PWD/actionjournal.cpp \
+    $$PWD/actionstatistics.cpp \
     $$PWD/emailaccountlistmodel.cpp \
+    $$PWD/bodysearchindex.cpp \
     $$PWD/emailmessagelistmodel.cpp \
     $$PWD/folderaccessor.cpp \
     $$PWD/folderlistmodel.cpp \
     $$PWD/folderlistproxymodel.cpp \
     $$PWD/folderlistfiltertypemodel.cpp \
     $$PWD/folderutils.cpp \
+    $$PWD/headersearchindex.cpp \
+    $$PWD/messagefieldwriter.cpp \
+    $$PWD/subjectutils.cpp \
     $$PWD/emailagent.cpp \
+    $$PWD/searchcoordinator.cpp \
     $$PWD/emailmessage.cpp \
     $$PWD/emailaccountsettingsmodel.cpp \
     $$PWD/emailaccount.cpp \
@@ -30,7 +37,10 @@ PUBLIC_HEADERS += \
     $$PWD/emailaccount.h \
 
 PRIVATE_HEADERS += \
+    $$PWD/actionjournal.h \
+    $$PWD/actionstatistics.h \
     $$PWD/attachmentlistmodel.h \
+    $$PWD/bodysearchindex.h \
     $$PWD/emailaccountlistmodel.h \
     $$PWD/emailfolder.h \
     $$PWD/emailmessagelistmodel.h \
@@ -39,6 +49,10 @@ PRIVATE_HEADERS += \
     $$PWD/folderlistproxymodel.h \
     $$PWD/folderlistfiltertypemodel.h \
     $$PWD/folderutils.h \
+    $$PWD/headersearchindex.h \
+    $$PWD/messagefieldwriter.h \
+    $$PWD/subjectutils.h \
+    $$PWD/searchcoordinator.h \
     $$PWD/logging_p.h \
 
 HEADERS += \
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include "subjectutils.h"
+
+// Both functions are single pass scanners equivalent to the regular expressions
+// "<\s*img", "<\s*a" and "^(re:|fw:|fwd:|\s*)*", matched case insensitively.
+// They are called for every row of a message list, so avoid regexp setup and
+// return the subject untouched (shared) in the common case.
+
+namespace {
+
+bool matchesAt(const QString &text, int pos, QLatin1String token)
+{
+    return text.midRef(pos, token.size()).compare(token, Qt::CaseInsensitive) == 0;
+}
+
+}
+
+QString SubjectUtils::parsedSubject(const QString &subject)
+{
+    int pos = subject.indexOf(QLatin1Char('<'));
+    if (pos < 0) {
+        return subject;
+    }
+
+    const int length = subject.length();
+    QString result;
+    int copied = 0;
+
+    while (pos >= 0) {
+        int tagStart = pos + 1;
+        while (tagStart < length && subject.at(tagStart).isSpace()) {
+            tagStart++;
+        }
+
+        QLatin1String replacement;
+        int matchEnd = 0;
+        if (matchesAt(subject, tagStart, QLatin1String("img"))) {
+            replacement = QLatin1String("<no-img");
+            matchEnd = tagStart + 3;
+        } else if (matchesAt(subject, tagStart, QLatin1String("a"))) {
+            replacement = QLatin1String("<no-a");
+            matchEnd = tagStart + 1;
+        }
+
+        if (matchEnd) {
+            if (result.isNull()) {
+                result.reserve(length + 8);
+            }
+            result.append(subject.midRef(copied, pos - copied));
+            result.append(replacement);
+            copied = matchEnd;
+            pos = subject.indexOf(QLatin1Char('<'), matchEnd);
+        } else {
+            pos = subject.indexOf(QLatin1Char('<'), pos + 1);
+        }
+    }
+
+    if (result.isNull()) {
+        return subject;
+    }
+    result.append(subject.midRef(copied));
+    return result;
+}
+
+QString SubjectUtils::trimmedSubject(const QString &subject)
+{
+    const int length = subject.length();
+    int pos = 0;
+
+    while (pos < length) {
+        while (pos < length && subject.at(pos).isSpace()) {
+            pos++;
+        }
+
+        if (matchesAt(subject, pos, QLatin1String("re:"))
+                || matchesAt(subject, pos, QLatin1String("fw:"))) {
+            pos += 3;
+        } else if (matchesAt(subject, pos, QLatin1String("fwd:"))) {
+            pos += 4;
+        } else {
+            break;
+        }
+    }
+
+    return pos ? subject.mid(pos) : subject;
+}
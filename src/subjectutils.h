@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef SUBJECTUTILS_H
+#define SUBJECTUTILS_H
+
+#include <QString>
+
+namespace SubjectUtils {
+
+// Neutralizes <img> and <a> tags so the subject can be shown in a StyledText label
+QString parsedSubject(const QString &subject);
+// Strips leading Re:, Fw: and Fwd: prefixes and whitespace
+QString trimmedSubject(const QString &subject);
+
+}
+
+#endif
@@ -1,8 +1,12 @@
 TEMPLATE = subdirs
 SUBDIRS = \
+    tst_actionjournal \
     tst_emailfolder \
     tst_emailmessage \
-    tst_folderlistmodel
+    tst_folderlistmodel \
+    tst_headersearchindex \
+    tst_messagefieldwriter \
+    tst_subjectutils
     
 
 tests_xml.target = tests.xml
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <QDateTime>
+#include <QFile>
+#include <QObject>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "actionjournal.h"
+
+/*
+    Unit test for ActionJournal. Each test uses a journal file of its own
+    and reads it back the way the agent does on the next start.
+*/
+class tst_ActionJournal : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void roundTrip();
+    void doneRecords();
+    void truncatedLastLine();
+    void ageCutoff();
+    void emptiedAfterTaking();
+    void compaction();
+
+private:
+    static ActionJournal::Entry entry(const QString &name, int value, qint64 created = 0);
+    int lineCount() const;
+
+    QTemporaryDir *m_dir;
+    QString m_fileName;
+};
+
+ActionJournal::Entry tst_ActionJournal::entry(const QString &name, int value, qint64 created)
+{
+    ActionJournal::Entry result;
+    result.name = name;
+    result.parameters.insert(QStringLiteral("value"), value);
+    result.priority = value % 3;
+    result.created = created ? created : QDateTime::currentMSecsSinceEpoch();
+    return result;
+}
+
+int tst_ActionJournal::lineCount() const
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    return file.readAll().count('\n');
+}
+
+void tst_ActionJournal::init()
+{
+    m_dir = new QTemporaryDir;
+    QVERIFY(m_dir->isValid());
+    m_fileName = m_dir->path() + QStringLiteral("/actions.journal");
+}
+
+void tst_ActionJournal::cleanup()
+{
+    delete m_dir;
+    m_dir = 0;
+}
+
+void tst_ActionJournal::roundTrip()
+{
+    const ActionJournal::Entry first = entry(QStringLiteral("delete-messages"), 1);
+    const ActionJournal::Entry second = entry(QStringLiteral("flag-messages"), 2);
+    {
+        ActionJournal journal(m_fileName);
+        journal.add(2, first);
+        journal.add(5, second);
+    }
+
+    ActionJournal journal(m_fileName);
+    const QList<ActionJournal::Entry> entries = journal.takeEntries(60 * 1000);
+    QCOMPARE(entries.count(), 2);
+    QCOMPARE(entries.at(0).name, first.name);
+    QCOMPARE(entries.at(0).parameters.value(QStringLiteral("value")).toInt(), 1);
+    QCOMPARE(entries.at(0).priority, first.priority);
+    QCOMPARE(entries.at(0).created, first.created);
+    QCOMPARE(entries.at(1).name, second.name);
+    QCOMPARE(entries.at(1).parameters.value(QStringLiteral("value")).toInt(), 2);
+}
+
+void tst_ActionJournal::doneRecords()
+{
+    {
+        ActionJournal journal(m_fileName);
+        journal.add(1, entry(QStringLiteral("first"), 1));
+        journal.add(2, entry(QStringLiteral("second"), 2));
+        journal.add(3, entry(QStringLiteral("third"), 3));
+        journal.remove(2);
+        // Not in the journal, leaves no record
+        journal.remove(4);
+    }
+    QCOMPARE(lineCount(), 4);
+
+    ActionJournal journal(m_fileName);
+    const QList<ActionJournal::Entry> entries = journal.takeEntries(60 * 1000);
+    QCOMPARE(entries.count(), 2);
+    QCOMPARE(entries.at(0).name, QStringLiteral("first"));
+    QCOMPARE(entries.at(1).name, QStringLiteral("third"));
+}
+
+void tst_ActionJournal::truncatedLastLine()
+{
+    {
+        ActionJournal journal(m_fileName);
+        journal.add(1, entry(QStringLiteral("first"), 1));
+        journal.add(2, entry(QStringLiteral("second"), 2));
+    }
+
+    // A write cut short by the process going away
+    QFile file(m_fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+    file.write("{\"id\":3,\"name\":\"thi");
+    file.close();
+
+    ActionJournal journal(m_fileName);
+    const QList<ActionJournal::Entry> entries = journal.takeEntries(60 * 1000);
+    QCOMPARE(entries.count(), 2);
+    QCOMPARE(entries.at(0).name, QStringLiteral("first"));
+    QCOMPARE(entries.at(1).name, QStringLiteral("second"));
+}
+
+void tst_ActionJournal::ageCutoff()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    {
+        ActionJournal journal(m_fileName);
+        journal.add(1, entry(QStringLiteral("old"), 1, now - 2 * 60 * 60 * 1000));
+        journal.add(2, entry(QStringLiteral("recent"), 2, now - 60 * 1000));
+    }
+
+    ActionJournal journal(m_fileName);
+    const QList<ActionJournal::Entry> entries = journal.takeEntries(60 * 60 * 1000);
+    QCOMPARE(entries.count(), 1);
+    QCOMPARE(entries.at(0).name, QStringLiteral("recent"));
+}
+
+void tst_ActionJournal::emptiedAfterTaking()
+{
+    {
+        ActionJournal journal(m_fileName);
+        journal.add(1, entry(QStringLiteral("first"), 1));
+    }
+    {
+        ActionJournal journal(m_fileName);
+        QCOMPARE(journal.takeEntries(60 * 1000).count(), 1);
+        // Queued again on this run
+        journal.add(7, entry(QStringLiteral("second"), 2));
+    }
+
+    ActionJournal journal(m_fileName);
+    const QList<ActionJournal::Entry> entries = journal.takeEntries(60 * 1000);
+    QCOMPARE(entries.count(), 1);
+    QCOMPARE(entries.at(0).name, QStringLiteral("second"));
+}
+
+void tst_ActionJournal::compaction()
+{
+    {
+        ActionJournal journal(m_fileName);
+        for (int i = 0; i < 200; i++) {
+            journal.add(i, entry(QStringLiteral("action"), i));
+        }
+        for (int i = 0; i < 190; i++) {
+            journal.remove(i);
+        }
+    }
+    // Without compaction the file would have a line per add and per removal
+    QVERIFY(lineCount() < 128);
+
+    ActionJournal journal(m_fileName);
+    const QList<ActionJournal::Entry> entries = journal.takeEntries(60 * 1000);
+    QCOMPARE(entries.count(), 10);
+    for (int i = 0; i < entries.count(); i++) {
+        QCOMPARE(entries.at(i).parameters.value(QStringLiteral("value")).toInt(), 190 + i);
+    }
+}
+
+QTEST_MAIN(tst_ActionJournal)
+
+#include "tst_actionjournal.moc"
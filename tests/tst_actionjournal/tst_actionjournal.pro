@@ -0,0 +1,4 @@
+include(../common.pri)
+TARGET = tst_actionjournal
+
+SOURCES += tst_actionjournal.cpp
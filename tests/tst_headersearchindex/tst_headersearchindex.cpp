@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <QObject>
+#include <QSet>
+#include <QTest>
+#include <qmailstore.h>
+
+#include "headersearchindex.h"
+
+/*
+    Unit test and benchmark for HeaderSearchIndex. The benchmarks compare
+    against the Includes keys the message list model uses without the index.
+*/
+class tst_HeaderSearchIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void indexesInBackground();
+    void search_data();
+    void search();
+    void shortText();
+    void followsStore();
+
+    void benchmarkKeyScan_data();
+    void benchmarkKeyScan();
+    void benchmarkIndex_data();
+    void benchmarkIndex();
+
+private:
+    static QMailMessageKey includesKey(const QString &text, HeaderSearchIndex::Fields fields);
+    QSet<QMailMessageId> keyMatches(const QString &text, HeaderSearchIndex::Fields fields) const;
+    bool indexSearch(const QString &text, HeaderSearchIndex::Fields fields, QMailMessageIdList *ids);
+
+    QMailAccount m_account;
+    QMailFolder m_folder;
+    HeaderSearchIndex *m_index;
+};
+
+QMailMessageKey tst_HeaderSearchIndex::includesKey(const QString &text, HeaderSearchIndex::Fields fields)
+{
+    QMailMessageKey key;
+    if (fields & HeaderSearchIndex::Sender) {
+        key |= QMailMessageKey::sender(text, QMailDataComparator::Includes);
+    }
+    if (fields & HeaderSearchIndex::Recipients) {
+        key |= QMailMessageKey::recipients(text, QMailDataComparator::Includes);
+    }
+    if (fields & HeaderSearchIndex::Subject) {
+        key |= QMailMessageKey::subject(text, QMailDataComparator::Includes);
+    }
+    return key;
+}
+
+QSet<QMailMessageId> tst_HeaderSearchIndex::keyMatches(const QString &text, HeaderSearchIndex::Fields fields) const
+{
+    return QMailStore::instance()->queryMessages(QMailMessageKey::parentFolderId(m_folder.id())
+                                                 & includesKey(text, fields)).toSet();
+}
+
+bool tst_HeaderSearchIndex::indexSearch(const QString &text, HeaderSearchIndex::Fields fields, QMailMessageIdList *ids)
+{
+    return m_index->search(text, fields, QMailAccountIdList() << m_account.id(), ids);
+}
+
+void tst_HeaderSearchIndex::initTestCase()
+{
+    QMailAccountConfiguration config;
+    m_account.setName("Header search account");
+    QVERIFY(QMailStore::instance()->addAccount(&m_account, &config));
+
+    m_folder = QMailFolder("HeaderSearchFolder", QMailFolderId(), m_account.id());
+    QVERIFY(QMailStore::instance()->addFolder(&m_folder));
+
+    const QStringList names = QStringList() << "Alice Andersson" << "Bob Brown" << "Carol Clark"
+                                            << "Dmitri Dorofeev" << "Eve Ekström" << "Frank Fischer";
+    const QStringList topics = QStringList() << "Quarterly report" << "Lunch on Friday" << "Build failure"
+                                             << "Re: Release notes" << "Fwd: Invoice 2026" << "Meeting minutes";
+
+    QList<QMailMessage *> messages;
+    for (int i = 0; i < 5000; i++) {
+        QMailMessage *message = new QMailMessage;
+        message->setMessageType(QMailMessage::Email);
+        message->setParentAccountId(m_account.id());
+        message->setParentFolderId(m_folder.id());
+        const QString sender = names.at(i % names.count());
+        const QString recipient = names.at((i / names.count()) % names.count());
+        message->setFrom(QMailAddress(sender, sender.section(' ', 0, 0).toLower() + "@example.org"));
+        message->setTo(QMailAddress(recipient, recipient.section(' ', 0, 0).toLower() + "@example.com"));
+        message->setSubject(QString("%1 #%2").arg(topics.at(i % topics.count())).arg(i));
+        message->setStatus(QMailMessage::Incoming, true);
+        messages.append(message);
+    }
+    QVERIFY(QMailStore::instance()->addMessages(messages));
+    qDeleteAll(messages);
+
+    m_index = new HeaderSearchIndex(this);
+}
+
+void tst_HeaderSearchIndex::cleanupTestCase()
+{
+    QMailStore::instance()->removeAccount(m_account.id());
+}
+
+void tst_HeaderSearchIndex::indexesInBackground()
+{
+    // The first search only starts indexing the account
+    QMailMessageIdList ids;
+    QVERIFY(!indexSearch(QString("alice"), HeaderSearchIndex::Sender, &ids));
+    QVERIFY(!m_index->isIndexed(QMailAccountIdList() << m_account.id()));
+    QTRY_VERIFY_WITH_TIMEOUT(m_index->isIndexed(QMailAccountIdList() << m_account.id()), 30000);
+    QCOMPARE(m_index->count(), 5000);
+    QVERIFY(indexSearch(QString("alice"), HeaderSearchIndex::Sender, &ids));
+}
+
+void tst_HeaderSearchIndex::search_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("fields");
+
+    const int all = HeaderSearchIndex::Sender | HeaderSearchIndex::Recipients | HeaderSearchIndex::Subject;
+    QTest::newRow("sender name") << "alice" << int(HeaderSearchIndex::Sender);
+    QTest::newRow("sender domain") << "example.org" << all;
+    QTest::newRow("recipient only") << "example.org" << int(HeaderSearchIndex::Recipients);
+    QTest::newRow("subject word") << "invoice" << int(HeaderSearchIndex::Subject);
+    QTest::newRow("subject number") << "#123" << int(HeaderSearchIndex::Subject);
+    QTest::newRow("mixed case") << "ReLeAsE" << all;
+    QTest::newRow("across words") << "on fri" << all;
+    QTest::newRow("non-latin") << "ström" << all;
+    QTest::newRow("no match") << "zzz" << all;
+}
+
+void tst_HeaderSearchIndex::search()
+{
+    QFETCH(QString, text);
+    QFETCH(int, fields);
+
+    QMailMessageIdList ids;
+    QVERIFY(indexSearch(text, HeaderSearchIndex::Fields(fields), &ids));
+
+    const QSet<QMailMessageId> indexMatches
+            = QMailStore::instance()->queryMessages(QMailMessageKey::parentFolderId(m_folder.id())
+                                                    & QMailMessageKey::id(ids)).toSet();
+    QCOMPARE(indexMatches, keyMatches(text, HeaderSearchIndex::Fields(fields)));
+}
+
+void tst_HeaderSearchIndex::shortText()
+{
+    QMailMessageIdList ids;
+    QVERIFY(!indexSearch(QString("al"), HeaderSearchIndex::Sender, &ids));
+    QVERIFY(!indexSearch(QString("alice"), HeaderSearchIndex::Fields(), &ids));
+}
+
+void tst_HeaderSearchIndex::followsStore()
+{
+    QMailMessageIdList ids;
+    QVERIFY(indexSearch(QString("unique marker"), HeaderSearchIndex::Subject, &ids));
+    QVERIFY(ids.isEmpty());
+
+    QMailMessage message;
+    message.setMessageType(QMailMessage::Email);
+    message.setParentAccountId(m_account.id());
+    message.setParentFolderId(m_folder.id());
+    message.setSubject("A unique marker");
+    QVERIFY(QMailStore::instance()->addMessage(&message));
+    QTRY_VERIFY(indexSearch(QString("unique marker"), HeaderSearchIndex::Subject, &ids) && ids.count() == 1);
+    QCOMPARE(ids.first(), message.id());
+
+    message.setSubject("Renamed");
+    QVERIFY(QMailStore::instance()->updateMessage(&message));
+    QTRY_VERIFY(indexSearch(QString("unique marker"), HeaderSearchIndex::Subject, &ids) && ids.isEmpty());
+    QTRY_VERIFY(indexSearch(QString("renamed"), HeaderSearchIndex::Subject, &ids) && ids.count() == 1);
+
+    QVERIFY(QMailStore::instance()->removeMessage(message.id()));
+    QTRY_VERIFY(indexSearch(QString("renamed"), HeaderSearchIndex::Subject, &ids) && ids.isEmpty());
+}
+
+void tst_HeaderSearchIndex::benchmarkKeyScan_data()
+{
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("common") << "example";
+    QTest::newRow("selective") << "#4321";
+}
+
+void tst_HeaderSearchIndex::benchmarkKeyScan()
+{
+    QFETCH(QString, text);
+    const HeaderSearchIndex::Fields fields(HeaderSearchIndex::Sender | HeaderSearchIndex::Recipients
+                                           | HeaderSearchIndex::Subject);
+
+    QBENCHMARK {
+        keyMatches(text, fields);
+    }
+}
+
+void tst_HeaderSearchIndex::benchmarkIndex_data()
+{
+    benchmarkKeyScan_data();
+}
+
+void tst_HeaderSearchIndex::benchmarkIndex()
+{
+    QFETCH(QString, text);
+    const HeaderSearchIndex::Fields fields(HeaderSearchIndex::Sender | HeaderSearchIndex::Recipients
+                                           | HeaderSearchIndex::Subject);
+    QMailMessageIdList ids;
+    // Indexing is paid once per process, keep it out of the measurement
+    QTRY_VERIFY(indexSearch(text, fields, &ids));
+
+    QBENCHMARK {
+        indexSearch(text, fields, &ids);
+        QMailStore::instance()->queryMessages(QMailMessageKey::parentFolderId(m_folder.id())
+                                              & QMailMessageKey::id(ids));
+    }
+}
+
+QTEST_MAIN(tst_HeaderSearchIndex)
+
+#include "tst_headersearchindex.moc"
@@ -0,0 +1,4 @@
+include(../common.pri)
+TARGET = tst_headersearchindex
+
+SOURCES += tst_headersearchindex.cpp
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <QObject>
+#include <QTest>
+#include <qmailstore.h>
+
+#include "messagefieldwriter.h"
+
+class tst_MessageFieldWriter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void writesAddedMessages();
+    void writesRequestedMessages();
+
+private:
+    QMailMessageMetaData storedMetaData(const QMailMessageId &id) const;
+    QMailMessageId addMessage();
+
+    QList<QMailAddress> m_to;
+    QList<QMailAddress> m_cc;
+    QMailAccount m_account;
+    QMailFolder m_folder;
+    MessageFieldWriter *m_writer;
+};
+
+void tst_MessageFieldWriter::initTestCase()
+{
+    QMailAccountConfiguration config;
+    m_account.setName("Message field account");
+    QVERIFY(QMailStore::instance()->addAccount(&m_account, &config));
+
+    m_folder = QMailFolder("MessageFieldFolder", QMailFolderId(), m_account.id());
+    QVERIFY(QMailStore::instance()->addFolder(&m_folder));
+
+    m_to << QMailAddress("Andersson, Bob", "bob@example.org") << QMailAddress("carol@example.org");
+    m_cc << QMailAddress("Dmitri Dorofeev", "dmitri@example.org");
+    m_writer = new MessageFieldWriter(this);
+}
+
+void tst_MessageFieldWriter::cleanupTestCase()
+{
+    QMailStore::instance()->removeAccount(m_account.id());
+}
+
+QMailMessageMetaData tst_MessageFieldWriter::storedMetaData(const QMailMessageId &id) const
+{
+    const QMailMessageMetaDataList metaDataList
+            = QMailStore::instance()->messagesMetaData(QMailMessageKey::id(id),
+                                                       QMailMessageKey::Id | QMailMessageKey::Custom);
+    return metaDataList.isEmpty() ? QMailMessageMetaData() : metaDataList.first();
+}
+
+QMailMessageId tst_MessageFieldWriter::addMessage()
+{
+    QMailMessage message;
+    message.setMessageType(QMailMessage::Email);
+    message.setParentAccountId(m_account.id());
+    message.setParentFolderId(m_folder.id());
+    message.setFrom(QMailAddress("Alice Andersson", "alice@example.org"));
+    message.setTo(m_to);
+    message.setCc(m_cc);
+    message.setSubject("Fields");
+    message.setStatus(QMailMessage::Incoming, true);
+
+    QMailMessageContentDisposition disposition(QMailMessageContentDisposition::Attachment);
+    disposition.setFilename("report.pdf");
+    QMailMessageContentType type("application/pdf");
+    type.setName("report.pdf");
+    message.setMultipartType(QMailMessagePartContainer::MultipartMixed);
+    message.appendPart(QMailMessagePart::fromData(QString("Body"),
+                                                  QMailMessageContentDisposition(QMailMessageContentDisposition::Inline),
+                                                  QMailMessageContentType("text/plain"),
+                                                  QMailMessageBody::Base64));
+    message.appendPart(QMailMessagePart::fromData(QByteArray("data"), disposition, type, QMailMessageBody::Base64));
+
+    if (!QMailStore::instance()->addMessage(&message)) {
+        return QMailMessageId();
+    }
+    return message.id();
+}
+
+void tst_MessageFieldWriter::writesAddedMessages()
+{
+    const QMailMessageId id = addMessage();
+    QVERIFY(id.isValid());
+
+    QTRY_VERIFY(MessageFieldWriter::hasFields(storedMetaData(id)));
+    const QMailMessageMetaData metaData = storedMetaData(id);
+    // A comma in a name must not split the address
+    QCOMPARE(MessageFieldWriter::addresses(MessageFieldWriter::addressField(metaData, MessageFieldWriter::To)),
+             QMailAddress::toStringList(m_to));
+    QCOMPARE(MessageFieldWriter::addresses(MessageFieldWriter::addressField(metaData, MessageFieldWriter::Cc)),
+             QMailAddress::toStringList(m_cc));
+    QVERIFY(MessageFieldWriter::addressField(metaData, MessageFieldWriter::Bcc).isEmpty());
+    QCOMPARE(MessageFieldWriter::attachmentNames(metaData), QStringList() << "report.pdf");
+}
+
+void tst_MessageFieldWriter::writesRequestedMessages()
+{
+    // A message stored while no writer was following the store
+    delete m_writer;
+    const QMailMessageId id = addMessage();
+    QVERIFY(id.isValid());
+    m_writer = new MessageFieldWriter(this);
+    QTest::qWait(200);
+    QVERIFY(!MessageFieldWriter::hasFields(storedMetaData(id)));
+
+    m_writer->request(QMailMessageIdList() << id);
+    QTRY_VERIFY(MessageFieldWriter::hasFields(storedMetaData(id)));
+    QCOMPARE(MessageFieldWriter::attachmentNames(storedMetaData(id)), QStringList() << "report.pdf");
+}
+
+QTEST_MAIN(tst_MessageFieldWriter)
+
+#include "tst_messagefieldwriter.moc"
@@ -0,0 +1,4 @@
+include(../common.pri)
+TARGET = tst_messagefieldwriter
+
+SOURCES += tst_messagefieldwriter.cpp
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2026 Open Mobile Platform LLC.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <QObject>
+#include <QTest>
+#include <QRegExp>
+#include <QStringList>
+
+#include "subjectutils.h"
+
+/*
+    Unit test and benchmark for SubjectUtils. The benchmarks compare
+    against the regular expressions the message list model used before.
+*/
+class tst_SubjectUtils : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void parsedSubject_data();
+    void parsedSubject();
+    void trimmedSubject_data();
+    void trimmedSubject();
+    void matchesRegExp();
+
+    void benchmarkParsedRegExp();
+    void benchmarkParsed();
+    void benchmarkTrimmedRegExp();
+    void benchmarkTrimmed();
+
+private:
+    static QString regExpParsedSubject(QString subject);
+    static QString regExpTrimmedSubject(QString subject);
+
+    QStringList m_subjects;
+};
+
+QString tst_SubjectUtils::regExpParsedSubject(QString subject)
+{
+    subject.replace(QRegExp("<\\s*img", Qt::CaseInsensitive), "<no-img");
+    subject.replace(QRegExp("<\\s*a", Qt::CaseInsensitive), "<no-a");
+    return subject;
+}
+
+QString tst_SubjectUtils::regExpTrimmedSubject(QString subject)
+{
+    return subject.replace(QRegExp(QStringLiteral("^(re:|fw:|fwd:|\\s*)*"), Qt::CaseInsensitive), QString());
+}
+
+void tst_SubjectUtils::initTestCase()
+{
+    // Mix of subjects as seen in typical mailboxes: replies, forwards,
+    // mailing list tags, html fragments and non-latin text.
+    const QStringList bases = {
+        QStringLiteral("Meeting notes for Tuesday"),
+        QStringLiteral("[dev-list] Patch review: fix crash on startup"),
+        QStringLiteral("Your order #12345 has been shipped"),
+        QStringLiteral("Invitation: Quarterly planning @ Thu 10:00 - 11:00"),
+        QStringLiteral("Lunch?"),
+        QStringLiteral("Check this <a href=\"http://example.com\">link</a>"),
+        QStringLiteral("Newsletter <img src=\"logo.png\"> October"),
+        QStringLiteral("Ответ на ваш запрос"),
+        QStringLiteral("Kokous huomenna klo 14"),
+        QStringLiteral("Build failed: master #4521"),
+        QStringLiteral("a < b and b > c"),
+        QStringLiteral("Photos from the weekend"),
+        QString()
+    };
+    const QStringList prefixes = {
+        QString(),
+        QStringLiteral("Re: "),
+        QStringLiteral("RE: "),
+        QStringLiteral("Fwd: "),
+        QStringLiteral("FW: "),
+        QStringLiteral("Re: Re: "),
+        QStringLiteral("  Re:Fwd: "),
+        QString()
+    };
+
+    for (int i = 0; i < 10000; i++) {
+        m_subjects << prefixes.at(i % prefixes.size()) + bases.at((i / prefixes.size() + i) % bases.size());
+    }
+}
+
+void tst_SubjectUtils::parsedSubject_data()
+{
+    QTest::addColumn<QString>("subject");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("plain") << "Hello world" << "Hello world";
+    QTest::newRow("empty") << "" << "";
+    QTest::newRow("img") << "See <img src=x>" << "See <no-img src=x>";
+    QTest::newRow("img with spaces") << "See <  IMG src=x>" << "See <no-img src=x>";
+    QTest::newRow("anchor") << "<a href=x>link</a>" << "<no-a href=x>link</a>";
+    QTest::newRow("anchor prefix") << "<abbr>" << "<no-abbr>";
+    QTest::newRow("comparison") << "a < b" << "a < b";
+    QTest::newRow("trailing bracket") << "a <" << "a <";
+    QTest::newRow("several") << "<a><img><b>" << "<no-a><no-img><b>";
+}
+
+void tst_SubjectUtils::parsedSubject()
+{
+    QFETCH(QString, subject);
+    QFETCH(QString, expected);
+
+    QCOMPARE(SubjectUtils::parsedSubject(subject), expected);
+}
+
+void tst_SubjectUtils::trimmedSubject_data()
+{
+    QTest::addColumn<QString>("subject");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("plain") << "Hello" << "Hello";
+    QTest::newRow("empty") << "" << "";
+    QTest::newRow("whitespace") << "   " << "";
+    QTest::newRow("reply") << "Re: Hello" << "Hello";
+    QTest::newRow("nested") << "RE: fwd:Fw: Hello" << "Hello";
+    QTest::newRow("no colon") << "Reply needed" << "Reply needed";
+    QTest::newRow("inner prefix") << "Hello Re: there" << "Hello Re: there";
+    QTest::newRow("leading space") << "  Fwd:  Hello" << "Hello";
+}
+
+void tst_SubjectUtils::trimmedSubject()
+{
+    QFETCH(QString, subject);
+    QFETCH(QString, expected);
+
+    QCOMPARE(SubjectUtils::trimmedSubject(subject), expected);
+}
+
+void tst_SubjectUtils::matchesRegExp()
+{
+    for (const QString &subject : m_subjects) {
+        QCOMPARE(SubjectUtils::parsedSubject(subject), regExpParsedSubject(subject));
+        QCOMPARE(SubjectUtils::trimmedSubject(subject), regExpTrimmedSubject(subject));
+    }
+}
+
+void tst_SubjectUtils::benchmarkParsedRegExp()
+{
+    QBENCHMARK {
+        for (const QString &subject : m_subjects) {
+            regExpParsedSubject(subject);
+        }
+    }
+}
+
+void tst_SubjectUtils::benchmarkParsed()
+{
+    QBENCHMARK {
+        for (const QString &subject : m_subjects) {
+            SubjectUtils::parsedSubject(subject);
+        }
+    }
+}
+
+void tst_SubjectUtils::benchmarkTrimmedRegExp()
+{
+    QBENCHMARK {
+        for (const QString &subject : m_subjects) {
+            regExpTrimmedSubject(subject);
+        }
+    }
+}
+
+void tst_SubjectUtils::benchmarkTrimmed()
+{
+    QBENCHMARK {
+        for (const QString &subject : m_subjects) {
+            SubjectUtils::trimmedSubject(subject);
+        }
+    }
+}
+
+#include "tst_subjectutils.moc"
+QTEST_MAIN(tst_SubjectUtils)
@@ -0,0 +1,4 @@
+include(../common.pri)
+TARGET = tst_subjectutils
+
+SOURCES += tst_subjectutils.cpp